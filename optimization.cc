@@ -81,7 +81,11 @@
 #include "optimization.h"
 #include "signalprocessing.h"
 #include <sstream>
+#include <ctime>
 #include <bitset>
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
 
 using namespace std;
 
@@ -90,6 +94,7 @@ namespace giac {
 #endif // ndef NO_NAMESPACE_GIAC
 
 #define GOLDEN_RATIO 1.61803398875
+#define NLP_MAX_HESSIAN_TERMS 100000
 typedef unsigned long ulong;
 
 gen make_idnt(const char* name,int index=-1,bool intern=true) {
@@ -102,6 +107,121 @@ gen make_idnt(const char* name,int index=-1,bool intern=true) {
     return identificateur(ss.str().c_str());
 }
 
+/*
+ * Return true iff g is an identifier or a command with the given name. This
+ * is used for parsing option keywords which are not reserved words.
+ */
+bool is_option(const gen &g,const char *name,GIAC_CONTEXT) {
+    return (g.type==_IDNT || g.type==_FUNC) && g.print(contextptr)==name;
+}
+
+/*
+ * OPT_TIMER CLASS IMPLEMENTATION
+ */
+
+/* return the current reading of the monotonic wall clock in seconds */
+double wall_time() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool opt_timer_enabled=false;
+static map<string,pair<long,long long> > opt_timer_counters;
+#ifdef HAVE_LIBPTHREAD
+static pthread_mutex_t opt_timer_mutex=PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+opt_timer::opt_timer(const char *ph) : phase(ph),active(opt_timer_enabled) {
+    if (active)
+        start=std::chrono::steady_clock::now();
+}
+
+opt_timer::~opt_timer() {
+    if (!active)
+        return;
+    long long ns=std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now()-start).count();
+#ifdef HAVE_LIBPTHREAD
+    pthread_mutex_lock(&opt_timer_mutex);
+#endif
+    pair<long,long long> &c=opt_timer_counters[phase];
+    ++c.first;
+    c.second+=ns;
+#ifdef HAVE_LIBPTHREAD
+    pthread_mutex_unlock(&opt_timer_mutex);
+#endif
+}
+
+void opt_timer::enable(bool yes) {
+#ifdef HAVE_LIBPTHREAD
+    pthread_mutex_lock(&opt_timer_mutex);
+#endif
+    if (yes)
+        opt_timer_counters.clear();
+    opt_timer_enabled=yes;
+#ifdef HAVE_LIBPTHREAD
+    pthread_mutex_unlock(&opt_timer_mutex);
+#endif
+}
+
+bool opt_timer::is_enabled() {
+    return opt_timer_enabled;
+}
+
+gen opt_timer::table() {
+    gen tab=makemap();
+    gen_map &m=*tab._MAPptr;
+#ifdef HAVE_LIBPTHREAD
+    pthread_mutex_lock(&opt_timer_mutex);
+#endif
+    for (map<string,pair<long,long long> >::const_iterator it=opt_timer_counters.begin();it!=opt_timer_counters.end();++it) {
+        m[string2gen(it->first,false)]=makevecteur(gen(it->second.first),gen(it->second.second));
+    }
+#ifdef HAVE_LIBPTHREAD
+    pthread_mutex_unlock(&opt_timer_mutex);
+#endif
+    return tab;
+}
+
+/*
+ * OPT_BUDGET CLASS IMPLEMENTATION
+ */
+
+bool opt_budget::parse_option(const gen &opt,GIAC_CONTEXT) {
+    if (!opt.is_symb_of_sommet(at_equal))
+        return false;
+    gen &lh=opt._SYMBptr->feuille._VECTptr->front();
+    gen rh=_evalf(opt._SYMBptr->feuille._VECTptr->back(),contextptr);
+    if (is_option(lh,"timeout",contextptr) && rh.type==_DOUBLE_ && rh.DOUBLE_val()>0)
+        timeout=rh.DOUBLE_val();
+    else if (is_option(lh,"maxcandidates",contextptr) && rh.type==_DOUBLE_ && rh.DOUBLE_val()>=1)
+        maxcand=int(rh.DOUBLE_val());
+    else return false;
+    return true;
+}
+
+bool opt_budget::exceeded() {
+    if (st==_OPT_BUDGET_OK && timeout>0 &&
+            std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count()>timeout)
+        st=_OPT_BUDGET_TIMEOUT;
+    return st!=_OPT_BUDGET_OK;
+}
+
+bool opt_budget::add_candidates(int k) {
+    ncand+=k;
+    if (st==_OPT_BUDGET_OK && maxcand>0 && ncand>=maxcand)
+        st=_OPT_BUDGET_MAXCANDIDATES;
+    return exceeded();
+}
+
+gen opt_budget::flag() const {
+    switch (st) {
+    case _OPT_BUDGET_TIMEOUT:
+        return identificateur("timeout");
+    case _OPT_BUDGET_MAXCANDIDATES:
+        return identificateur("maxcandidates");
+    }
+    return undef;
+}
+
 /*
  * Return true iff the expression 'e' is constant with respect to
  * variables in 'vars'.
@@ -133,6 +253,7 @@ bool is_rational_wrt_vars(const gen &e,const vecteur &vars,GIAC_CONTEXT) {
  * is found inside trigonometric, hyperbolic or exponential functions.
  */
 vecteur solve2(const vecteur &e_orig,const vecteur &vars_orig,GIAC_CONTEXT) {
+    opt_timer timer("solve2");
     int m=e_orig.size(),n=vars_orig.size(),i=0;
     for (;i<m;++i) {
         if (!is_rational_wrt_vars(e_orig[i],vars_orig,contextptr))
@@ -251,11 +372,194 @@ vecteur make_temp_vars(const vecteur &vars,const vecteur &ineq,GIAC_CONTEXT) {
     return tmpvars;
 }
 
+/*
+ * OPTCACHE CLASS IMPLEMENTATION
+ */
+
+#ifdef HAVE_LIBPTHREAD
+static pthread_mutex_t optcache_mutex=PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/* lock the cache during the lifetime of the object */
+class optcache_lock {
+public:
+#ifdef HAVE_LIBPTHREAD
+    optcache_lock() { pthread_mutex_lock(&optcache_mutex); }
+    ~optcache_lock() { pthread_mutex_unlock(&optcache_mutex); }
+#endif
+};
+
+optcache::~optcache() {
+    clear();
+}
+
+optcache &optcache::instance() {
+    static optcache cache;
+    return cache;
+}
+
+/* write the structure of g to os, floating-point numbers are written exactly */
+void optcache_serialize(const gen &g,ostream &os,GIAC_CONTEXT) {
+    char buf[32];
+    switch (g.type) {
+    case _DOUBLE_:
+        sprintf(buf,"%.17g",g.DOUBLE_val());
+        os << buf;
+        break;
+    case _CPLX:
+        os << "(";
+        optcache_serialize(*g._CPLXptr,os,contextptr);
+        os << ",";
+        optcache_serialize(*(g._CPLXptr+1),os,contextptr);
+        os << ")";
+        break;
+    case _VECT:
+        os << "[" << int(g.subtype) << ":";
+        for (const_iterateur it=g._VECTptr->begin();it!=g._VECTptr->end();++it) {
+            optcache_serialize(*it,os,contextptr);
+            os << ",";
+        }
+        os << "]";
+        break;
+    case _SYMB:
+        os << g._SYMBptr->sommet.ptr()->s << "(";
+        optcache_serialize(g._SYMBptr->feuille,os,contextptr);
+        os << ")";
+        break;
+    default:
+        os << g.print(contextptr);
+    }
+}
+
+string optcache::key(const char *kind,const vecteur &parts,GIAC_CONTEXT) {
+    stringstream ss;
+    ss << kind << ";" << approx_mode(contextptr) << complex_mode(contextptr);
+    for (const_iterateur it=parts.begin();it!=parts.end();++it) {
+        ss << ";";
+        optcache_serialize(*it,ss,contextptr);
+    }
+    // the results may depend on the assumptions on the identifiers
+    vecteur ids=*_lname(parts,contextptr)._VECTptr;
+    for (const_iterateur it=ids.begin();it!=ids.end();++it) {
+        gen a=_about(*it,contextptr);
+        if (a!=*it) {
+            ss << ";" << it->print(contextptr) << ":";
+            optcache_serialize(a,ss,contextptr);
+        }
+    }
+    return ss.str();
+}
+
+bool optcache::find(const string &key,gen &value) {
+    optcache_lock lock;
+    map<string,entry_list::iterator>::iterator it=index.find(key);
+    if (it==index.end() || it->second->second.prob!=NULL) {
+        ++misses;
+        return false;
+    }
+    ++hits;
+    entries.splice(entries.begin(),entries,it->second);
+    value=it->second->second.value;
+    return true;
+}
+
+nlprob *optcache::find_problem(const string &key) {
+    optcache_lock lock;
+    map<string,entry_list::iterator>::iterator it=index.find(key);
+    if (it==index.end() || it->second->second.prob==NULL) {
+        ++misses;
+        return NULL;
+    }
+    ++hits;
+    entries.splice(entries.begin(),entries,it->second);
+    return new nlprob(*it->second->second.prob);
+}
+
+void optcache::insert(const string &key,const entry &e) {
+    optcache_lock lock;
+    if (capacity==0 || index.find(key)!=index.end()) {
+        delete e.prob;
+        return;
+    }
+    entries.push_front(make_pair(key,e));
+    index[key]=entries.begin();
+    shrink();
+}
+
+void optcache::store(const string &key,const gen &value) {
+    entry e;
+    e.value=value;
+    e.prob=NULL;
+    insert(key,e);
+}
+
+void optcache::store_problem(const string &key,const nlprob &prob) {
+    entry e;
+    e.prob=new nlprob(prob);
+    insert(key,e);
+}
+
+void optcache::shrink() {
+    while (int(entries.size())>capacity) {
+        index.erase(entries.back().first);
+        delete entries.back().second.prob;
+        entries.pop_back();
+    }
+}
+
+void optcache::set_capacity(int cap) {
+    optcache_lock lock;
+    capacity=std::max(0,cap);
+    shrink();
+}
+
+void optcache::clear() {
+    optcache_lock lock;
+    for (entry_list::iterator it=entries.begin();it!=entries.end();++it) {
+        delete it->second.prob;
+    }
+    entries.clear();
+    index.clear();
+    hits=misses=0;
+}
+
+gen optcache::stats() const {
+    optcache_lock lock;
+    gen tab=makemap();
+    gen_map &m=*tab._MAPptr;
+    m[string2gen("hits",false)]=hits;
+    m[string2gen("misses",false)]=misses;
+    m[string2gen("entries",false)]=int(entries.size());
+    m[string2gen("capacity",false)]=capacity;
+    return tab;
+}
+
+/*
+ * Compile the problem with objective f, equality constraints eq=0 and
+ * inequality constraints ineq>=0, or get it from the cache.
+ */
+nlprob nlp_compile(const gen &f,const vecteur &eq,const vecteur &ineq,const vecteur &vars,const vecteur &params,bool fd,GIAC_CONTEXT) {
+    opt_timer timer("nlp_compile");
+    string key=optcache::key("nlprob",makevecteur(f,eq,ineq,vars,params,fd?1:0),contextptr);
+    nlprob *cached=optcache::instance().find_problem(key);
+    if (cached!=NULL) {
+        nlprob prob(*cached);
+        delete cached;
+        return prob;
+    }
+    nlprob prob(f,eq,ineq,vars,params,fd,contextptr);
+    if (prob.is_valid())
+        optcache::instance().store_problem(key,prob);
+    return prob;
+}
+
 /*
  * Determine critical points of function f under constraints g<=0 and h=0 using
- * Karush-Kuhn-Tucker conditions.
+ * Karush-Kuhn-Tucker conditions. The active sets are tried one by one until
+ * the budget (if given) is exceeded.
  */
-vecteur solve_kkt(gen &f,vecteur &g,vecteur &h,vecteur &vars_orig,GIAC_CONTEXT) {
+vecteur solve_kkt(gen &f,vecteur &g,vecteur &h,vecteur &vars_orig,opt_budget *budget,GIAC_CONTEXT) {
+    opt_timer timer("solve_kkt");
     int n=vars_orig.size(),m=g.size(),l=h.size();
     vecteur vars(vars_orig),gr_f(*_grad(makesequence(f,vars_orig),contextptr)._VECTptr),mug;
     matrice gr_g,gr_h;
@@ -284,6 +588,8 @@ vecteur solve_kkt(gen &f,vecteur &g,vecteur &h,vecteur &vars_orig,GIAC_CONTEXT)
     vector<bool> is_mu_zero(m,false);
     matrice cv;
     do {
+        if (budget!=NULL && budget->exceeded())
+            break;
         vecteur e(eqv);
         vecteur v(vars);
         for (int i=m-1;i>=0;--i) {
@@ -294,7 +600,10 @@ vecteur solve_kkt(gen &f,vecteur &g,vecteur &h,vecteur &vars_orig,GIAC_CONTEXT)
             else
                 e.push_back(g[i]);
         }
-        cv=mergevecteur(cv,solve2(e,v,contextptr));
+        vecteur sol=solve2(e,v,contextptr);
+        cv=mergevecteur(cv,sol);
+        if (budget!=NULL && budget->add_candidates(sol.size()))
+            break;
     } while(next_binary_perm(is_mu_zero));
     vars.resize(n);
     for (int i=cv.size()-1;i>=0;--i) {
@@ -315,6 +624,7 @@ vecteur solve_kkt(gen &f,vecteur &g,vecteur &h,vecteur &vars_orig,GIAC_CONTEXT)
  * derivative. Also, bounds of the range of x are critical points.
  */
 matrice critical_univariate(const gen &f,const gen &x,GIAC_CONTEXT) {
+    opt_timer timer("critical_univariate");
     gen df(_derive(makesequence(f,x),contextptr));
     matrice cv(*_zeros(makesequence(df,x),contextptr)._VECTptr);
     gen den(_denom(df,contextptr));
@@ -334,22 +644,34 @@ matrice critical_univariate(const gen &f,const gen &x,GIAC_CONTEXT) {
 /*
  * Compute global minimum mn and global maximum mx of function f(vars) under
  * conditions g<=0 and h=0. The list of points where global minimum is achieved
- * is returned.
+ * is returned. If the budget is exceeded, only the critical points found so far
+ * are considered.
  */
-vecteur global_extrema(gen &f,vecteur &g,vecteur &h,vecteur &vars,gen &mn,gen &mx,GIAC_CONTEXT) {
+vecteur global_extrema(gen &f,vecteur &g,vecteur &h,vecteur &vars,gen &mn,gen &mx,opt_budget *budget,GIAC_CONTEXT) {
+    opt_timer timer("global_extrema");
     int n=vars.size();
     matrice cv;
-    vecteur tmpvars=make_temp_vars(vars,g,contextptr);
-    gen ff=subst(f,vars,tmpvars,false,contextptr);
-    if (n==1) {
-        cv=critical_univariate(ff,tmpvars[0],contextptr);
-        for (const_iterateur it=g.begin();it!=g.end();++it) {
-            cv.push_back(makevecteur(it->_SYMBptr->feuille._VECTptr->back()));
+    // the critical points depend only on the problem, so they are cached
+    string key=optcache::key("critical points",makevecteur(f,g,h,vars),contextptr);
+    gen cached;
+    if (optcache::instance().find(key,cached))
+        cv=*cached._VECTptr;
+    else {
+        vecteur tmpvars=make_temp_vars(vars,g,contextptr);
+        gen ff=subst(f,vars,tmpvars,false,contextptr);
+        if (n==1) {
+            cv=critical_univariate(ff,tmpvars[0],contextptr);
+            for (const_iterateur it=g.begin();it!=g.end();++it) {
+                cv.push_back(makevecteur(it->_SYMBptr->feuille._VECTptr->back()));
+            }
+        } else {
+            vecteur gg=subst(g,vars,tmpvars,false,contextptr);
+            vecteur hh=subst(h,vars,tmpvars,false,contextptr);
+            cv=solve_kkt(ff,gg,hh,tmpvars,budget,contextptr);
         }
-    } else {
-        vecteur gg=subst(g,vars,tmpvars,false,contextptr);
-        vecteur hh=subst(h,vars,tmpvars,false,contextptr);
-        cv=solve_kkt(ff,gg,hh,tmpvars,contextptr);
+        // incomplete results are not cached
+        if (budget==NULL || budget->get_status()==opt_budget::_OPT_BUDGET_OK)
+            optcache::instance().store(key,cv);
     }
     if (cv.empty())
         return vecteur(0);
@@ -408,6 +730,51 @@ int parse_varlist(const gen &g,vecteur &vars,vecteur &ineq,vecteur &initial,GIAC
     return n;
 }
 
+/*
+ * Minimize f numerically subject to ineq>=0 and eq=0 and the bounds lo<=vars<=hi
+ * by running local IPM solves from multiple start points inside the bounds.
+ * Return the minimal value and store the points where it is attained to loc,
+ * or return undef if no local solution was found.
+ */
+gen minimize_numeric(const gen &f,const vecteur &ineq,const vecteur &eq,const vecteur &vars,
+                     const vector<double> &lo,const vector<double> &hi,vecteur &loc,GIAC_CONTEXT) {
+    opt_timer timer("minimize_numeric");
+    int n=vars.size(),nstarts=std::min(100,std::max(20,10*n));
+    nlprob prob(nlp_compile(f,eq,ineq,vars,vecteur(0),false,contextptr));
+    if (!prob.is_valid()) {
+        *logptr(contextptr) << "Error: failed to compile the problem" << endl;
+        return undef;
+    }
+    prob.set_bounds(lo,hi);
+    // start from the center of the box
+    vector<double> x0(n),w;
+    for (int j=0;j<n;++j) {
+        bool fa=lo[j]>-HUGE_VAL,fb=hi[j]<HUGE_VAL;
+        x0[j]=fa && fb?(lo[j]+hi[j])/2:(fa?lo[j]+1:(fb?hi[j]-1:0));
+    }
+    vector<vector<double> > starts,sols;
+    prob.start_points(x0,nstarts,starts,w,contextptr);
+    prob.multistart(starts,w,0.5*std::pow(double(nstarts),-1.0/n),1e-10,3000,1,sols);
+    if (sols.empty())
+        return undef;
+    vector<double> fv(sols.size());
+    for (int k=0;k<int(sols.size());++k) {
+        fv[k]=prob.objective(sols[k]);
+    }
+    double mn=*std::min_element(fv.begin(),fv.end());
+    loc.clear();
+    for (int k=0;k<int(sols.size());++k) {
+        if (fv[k]-mn>1e-8*std::max(1.0,std::abs(mn)))
+            continue;
+        vecteur pt(n);
+        for (int j=0;j<n;++j) {
+            pt[j]=gen(sols[k][j]);
+        }
+        loc.push_back(n==1?pt.front():gen(pt));
+    }
+    return gen(mn);
+}
+
 /*
  * Function 'minimize' minimizes a multivariate continuous function on a
  * closed and bounded region using the method of Lagrange multipliers. The
@@ -416,7 +783,7 @@ int parse_varlist(const gen &g,vecteur &vars,vecteur &ineq,vecteur &initial,GIAC
  *
  * Usage
  * ^^^^^
- *     minimize(obj,[constr],vars,[opt])
+ *     minimize(obj,[constr],vars,[opt],[numeric],[budget])
  *
  * Parameters
  * ^^^^^^^^^^
@@ -427,6 +794,8 @@ int parse_varlist(const gen &g,vecteur &vars,vecteur &ineq,vecteur &initial,GIAC
  *   - vars                : single variable or a list of problem variables, where
  *                           optional bounds of a variable may be set by appending '=a..b'
  *   - location (optional) : the option keyword 'locus' or 'coordinates' or 'point'
+ *   - numeric (optional)  : the option keyword 'numeric'
+ *   - budget (optional)   : 'timeout=<seconds>' and/or 'maxcandidates=<posint>'
  *
  * Objective function must be continuous in all points of the feasible region,
  * which is assumed to be closed and bounded. If one of these condinitions is
@@ -444,7 +813,22 @@ int parse_varlist(const gen &g,vecteur &vars,vecteur &ineq,vecteur &initial,GIAC
  * which the function is not differentiable are also considered critical. This
  * function also handles univariate piecewise functions.
  *
- * If no critical points were obtained, the return value is undefined.
+ * If no critical points were obtained, the return value is undefined, unless
+ * the option 'numeric' is given. In that case the minimum is searched for
+ * numerically by running local interior point solves from multiple start
+ * points sampled inside the variable ranges, and the keyword 'numeric' is
+ * appended to the result to indicate that it is approximate.
+ *
+ * The options 'timeout' and 'maxcandidates' limit the running time and the
+ * number of critical points obtained from the KKT conditions, respectively.
+ * The limits are checked between the active sets tried. When one is reached,
+ * the best of the critical points found so far is returned, followed by the
+ * name of the option whose limit was reached. If no critical point was found
+ * by then and 'numeric' is given, the numeric search is used instead.
+ *
+ * The critical points are cached (see 'optcache'), so minimizing the same
+ * function under the same constraints again does not repeat the symbolic
+ * computation.
  *
  * Examples
  * ^^^^^^^^
@@ -492,17 +876,28 @@ int parse_varlist(const gen &g,vecteur &vars,vecteur &ineq,vecteur &initial,GIAC
  *    >> 1.41421356237
  * minimize(z*x*exp(y),z^2+x^2+exp(2y)=1,[x,y,z])
  *    >> -sqrt(3)/9
+ * minimize(x*exp(sin(x*y))+y^2,[x=-2..2,y=-2..2],point,numeric)
+ *    >> -4.87194923912,[[-2.0,-0.718523609162]],numeric
  */
 gen _minimize(const gen &args,GIAC_CONTEXT) {
     if (args.type==_STRNG && args.subtype==-1) return args;
-    if (args.type!=_VECT || args.subtype!=_SEQ__VECT || args._VECTptr->size()>4)
+    opt_timer timer("minimize");
+    if (args.type!=_VECT || args.subtype!=_SEQ__VECT || args._VECTptr->size()>7)
         return gentypeerr(contextptr);
     vecteur &argv=*args._VECTptr,g,h;
-    bool location=false;
+    bool location=false,numeric=false;
     int nargs=argv.size();
-    if (argv.back()==at_coordonnees || argv.back()==at_lieu || argv.back()==at_point) {
-        location=true;
-        --nargs;
+    gen flag;
+    opt_budget budget;
+    for (;nargs>2;--nargs) {
+        const gen &opt=argv[nargs-1];
+        if (opt==at_coordonnees || opt==at_lieu || opt==at_point)
+            location=true;
+        else if (is_option(opt,"numeric",contextptr)) {
+            numeric=true;
+            flag=opt;
+        } else if (!budget.parse_option(opt,contextptr))
+            break;
     }
     if (nargs==3) {
         vecteur constr(argv[1].type==_VECT ? *argv[1]._VECTptr : vecteur(1,argv[1]));
@@ -520,6 +915,20 @@ gen _minimize(const gen &args,GIAC_CONTEXT) {
     int n;  // number of variables
     if ((n=parse_varlist(argv[nargs-1],vars,g,initial,contextptr))==0 || !initial.empty())
         return gensizeerr(contextptr);
+    // for the numeric fallback, separate the variable bounds from the other inequalities
+    vector<double> lo(n,-HUGE_VAL),hi(n,HUGE_VAL);
+    vecteur nineq;
+    for (const_iterateur it=g.begin();numeric && it!=g.end();++it) {
+        vecteur &s=*it->_SYMBptr->feuille._VECTptr;
+        bool ge=it->is_symb_of_sommet(at_superieur_egal);
+        int j=equalposcomp(vars,s[0])-1;
+        gen b=_evalf(s[1],contextptr);
+        if (j>=0 && b.type==_DOUBLE_) {
+            if (ge)
+                lo[j]=std::max(lo[j],b.DOUBLE_val());
+            else hi[j]=std::min(hi[j],b.DOUBLE_val());
+        } else nineq.push_back(ge?s[0]-s[1]:s[1]-s[0]);
+    }
     if (n>1) {
         for (int i=0;i<int(g.size());++i) {
             gen &gi=g[i];
@@ -529,7 +938,29 @@ gen _minimize(const gen &args,GIAC_CONTEXT) {
     }
     gen &f=argv[0];
     gen mn,mx;
-    vecteur loc(global_extrema(f,g,h,vars,mn,mx,contextptr));
+    vecteur loc(global_extrema(f,g,h,vars,mn,mx,&budget,contextptr));
+    if (budget.get_status()!=opt_budget::_OPT_BUDGET_OK) {
+        // return the best of the critical points found so far, flagged by the exceeded limit
+        if (loc.empty() && numeric) {
+            // fall back to the numeric search, flagged by both keywords
+            if (is_undef(mn=minimize_numeric(f,nineq,h,vars,lo,hi,loc,contextptr)))
+                return undef;
+            return location?makesequence(mn,loc,flag,budget.flag()):makesequence(mn,flag,budget.flag());
+        }
+        if (loc.empty()) {
+            *logptr(contextptr) << "Error: no critical points were found within the budget" << endl;
+            return undef;
+        }
+        *logptr(contextptr) << "Warning: the budget was exceeded, the result may not be optimal" << endl;
+        mn=_simplify(mn,contextptr);
+        return location?makesequence(mn,_simplify(loc,contextptr),budget.flag()):makesequence(mn,budget.flag());
+    }
+    if (loc.empty() && numeric) {
+        // no critical points were obtained, search for the minimum numerically
+        if (is_undef(mn=minimize_numeric(f,nineq,h,vars,lo,hi,loc,contextptr)))
+            return undef;
+        return location?makesequence(mn,loc,flag):makesequence(mn,flag);
+    }
     if (loc.empty())
         return undef;
     if (location)
@@ -790,6 +1221,7 @@ void ipdiff::find_nearest_terms(const ivector &sig,diffterms &match,ivector &exc
 }
 
 void ipdiff::raise_order(int order) {
+    opt_timer timer("ipdiff::raise_order");
     if (g.empty())
         return;
     ivectors c;
@@ -974,6 +1406,7 @@ gen ipdiff::taylor(const vecteur &a,int order) {
  */
 
 void vars_arrangements(matrice J,ipdiff::ivectors &arrs,GIAC_CONTEXT) {
+    opt_timer timer("vars_arrangements");
     int m=J.size(),n=J.front()._VECTptr->size();
     assert(n<=32 && m<n);
     matrice tJ(mtran(J));
@@ -1102,6 +1535,7 @@ bool ck_jacobian(vecteur &g,vecteur &vars,GIAC_CONTEXT) {
  */
 gen _implicitdiff(const gen &g,GIAC_CONTEXT) {
     if (g.type==_STRNG && g.subtype==-1) return g;
+    opt_timer timer("implicitdiff");
     if (g.type!=_VECT || g.subtype!=_SEQ__VECT || g._VECTptr->size()<2)
         return gentypeerr(contextptr);
     vecteur &gv=*g._VECTptr;
@@ -1263,7 +1697,8 @@ static define_unary_function_eval (__implicitdiff,&_implicitdiff,_implicitdiff_s
 define_unary_function_ptr5(at_implicitdiff,alias_at_implicitdiff,&__implicitdiff,0,true)
 
 void find_local_extrema(gen_map &cpts,const gen &f,const vecteur &g,const vecteur &vars,const ipdiff::ivector &arr,
-                        const vecteur &ineq,const vecteur &initial,int order_size,GIAC_CONTEXT) {
+                        const vecteur &ineq,const vecteur &initial,int order_size,opt_budget *budget,GIAC_CONTEXT) {
+    opt_timer timer("find_local_extrema");
     assert(order_size>=0);
     int nv=vars.size(),m=g.size(),n=nv-m,cls;
     vecteur tmpvars=make_temp_vars(vars,ineq,contextptr);
@@ -1289,8 +1724,13 @@ void find_local_extrema(gen_map &cpts,const gen &f,const vecteur &g,const vecteu
         }
         if (!cv.empty())
             bhess=*_hessian(makesequence(L,allvars),contextptr)._VECTptr; // bordered Hessian
+        opt_timer ctimer("find_local_extrema (classification)");
         gen s,cpt;
         for (const_iterateur it=cv.begin();it!=cv.end();++it) {
+            if (budget!=NULL && budget->exceeded())
+                break;
+            if (budget!=NULL)
+                budget->add_candidates();
             matrice H=subst(bhess,allvars,*it,false,contextptr);
             cls=_CPCLASS_UNDECIDED;
             for (int k=1;k<=n;++k) {
@@ -1328,9 +1768,14 @@ void find_local_extrema(gen_map &cpts,const gen &f,const vecteur &g,const vecteu
         }
         if (cv.empty())
             return;
+        opt_timer ctimer("find_local_extrema (classification)");
         if (nv==1) {
             gen d,x=vars.front();
             for (const_iterateur it=cv.begin();it!=cv.end();++it) {
+                if (budget!=NULL && budget->exceeded())
+                    break;
+                if (budget!=NULL)
+                    budget->add_candidates();
                 gen &x0=it->_VECTptr->front();
                 cls=_CPCLASS_UNDECIDED;
                 for (int k=2;k<=order_size;++k) {
@@ -1352,6 +1797,10 @@ void find_local_extrema(gen_map &cpts,const gen &f,const vecteur &g,const vecteu
                 a[i]=make_idnt("a",i);
             }
             for (const_iterateur it=cv.begin();it!=cv.end();++it) {
+                if (budget!=NULL && budget->exceeded())
+                    break;
+                if (budget!=NULL)
+                    budget->add_candidates();
                 for (int j=0;j<nv;++j) {
                     cpt_arr[arr[j]]=it->_VECTptr->at(j);
                 }
@@ -1390,7 +1839,7 @@ void find_local_extrema(gen_map &cpts,const gen &f,const vecteur &g,const vecteu
                             sphere+=pow(vars[j]-it->_VECTptr->at(j),2);
                         }
                         vecteur gp,hp(1,sphere);
-                        if (global_extrema(p,gp,hp,fvars,pmin,pmax,contextptr).empty())
+                        if (global_extrema(p,gp,hp,fvars,pmin,pmax,NULL,contextptr).empty())
                             break;
                         if (is_zero(pmin) && is_zero(pmax)) // p is nullpoly
                             continue;
@@ -1420,7 +1869,7 @@ void find_local_extrema(gen_map &cpts,const gen &f,const vecteur &g,const vecteu
  *
  * Usage
  * ^^^^^
- *     extrema(expr,[constr],vars,[order_size])
+ *     extrema(expr,[constr],vars,[order_size],[budget])
  *
  * Parameters
  * ^^^^^^^^^^
@@ -1430,6 +1879,7 @@ void find_local_extrema(gen_map &cpts,const gen &f,const vecteur &g,const vecteu
  *   - order_size (optional) : specify 'order_size=<nonnegative integer>' to
  *                             bound the order of the derivatives being
  *                             inspected when classifying the critical points
+ *   - budget (optional)     : 'timeout=<seconds>' and/or 'maxcandidates=<posint>'
  *
  * The number of constraints must be less than the number of variables. When
  * there are more than one constraint/variable, they must be specified in
@@ -1470,6 +1920,12 @@ void find_local_extrema(gen_map &cpts,const gen &f,const vecteur &g,const vecteu
  * about critical points for which no decision could be made, so that the user
  * can inspect candidates for local extrema by plotting the graph, for example.
  *
+ * The options 'timeout' and 'maxcandidates' limit the running time and the
+ * number of classified critical points, respectively. The limits are checked
+ * before each variable arrangement and each critical point is classified. When
+ * one is reached, the extrema found so far are returned, followed by the name
+ * of the option whose limit was reached.
+ *
  * Examples
  * ^^^^^^^^
  * extrema(-2*cos(x)-cos(x)^2,x)
@@ -1605,21 +2061,23 @@ void find_local_extrema(gen_map &cpts,const gen &f,const vecteur &g,const vecteu
  */
 gen _extrema(const gen &g,GIAC_CONTEXT) {
     if (g.type==_STRNG && g.subtype==-1) return g;
+    opt_timer timer("extrema");
     if (g.type!=_VECT || g.subtype!=_SEQ__VECT)
         return gentypeerr(contextptr);
     vecteur &gv=*g._VECTptr,constr;
     int order_size=5; // will not compute the derivatives of order higher than 'order_size'
     int ngv=gv.size();
-    if (gv.back()==at_lagrange) {
-        order_size=0; // use Lagrange method
-        --ngv;
-    } else if (gv.back().is_symb_of_sommet(at_equal)) {
-        vecteur &v=*gv.back()._SYMBptr->feuille._VECTptr;
-        if (v[0]==at_order_size && is_integer(v[1])) {
-            if ((order_size=v[1].val)<1)
+    opt_budget budget;
+    for (;ngv>2;--ngv) {
+        const gen &opt=gv[ngv-1];
+        if (opt==at_lagrange)
+            order_size=0; // use Lagrange method
+        else if (opt.is_symb_of_sommet(at_equal) && opt._SYMBptr->feuille._VECTptr->front()==at_order_size &&
+                 is_integer(opt._SYMBptr->feuille._VECTptr->back())) {
+            if ((order_size=opt._SYMBptr->feuille._VECTptr->back().val)<1)
                 return gensizeerr("Expected a positive integer,");
-            --ngv;
-        }
+        } else if (!budget.parse_option(opt,contextptr))
+            break;
     }
     if (ngv<2 || ngv>3)
         return gensizeerr("Wrong number of input arguments,");
@@ -1644,34 +2102,55 @@ gen _extrema(const gen &g,GIAC_CONTEXT) {
         if (it->is_symb_of_sommet(at_equal))
             *it=equal2diff(*it);
     }
-    ipdiff::ivectors arrs;
-    if (order_size>0 && !constr.empty()) {
-        matrice J(jacobian(constr,vars,contextptr));
-        if (constr.size()>=vars.size() || _rank(J,contextptr).val<int(constr.size()))
-            return gendimerr("Too many constraints,");
-        vars_arrangements(J,arrs,contextptr);
+    gen_map cpts;
+    // the classified critical points are cached as the list of pairs [point,class]
+    string key=optcache::key("extrema",makevecteur(gv[0],constr,vars,ineq,initial,order_size),contextptr);
+    gen cached;
+    if (optcache::instance().find(key,cached)) {
+        for (const_iterateur it=cached._VECTptr->begin();it!=cached._VECTptr->end();++it) {
+            cpts[it->_VECTptr->front()]=it->_VECTptr->back();
+        }
     } else {
-        ipdiff::ivector arr(nv);
-        for (int i=0;i<nv;++i) {
-            arr[i]=i;
+        ipdiff::ivectors arrs;
+        if (order_size>0 && !constr.empty()) {
+            matrice J(jacobian(constr,vars,contextptr));
+            if (constr.size()>=vars.size() || _rank(J,contextptr).val<int(constr.size()))
+                return gendimerr("Too many constraints,");
+            vars_arrangements(J,arrs,contextptr);
+        } else {
+            ipdiff::ivector arr(nv);
+            for (int i=0;i<nv;++i) {
+                arr[i]=i;
+            }
+            arrs.push_back(arr);
         }
-        arrs.push_back(arr);
-    }
-    gen_map cpts;
-    vecteur tmp_vars(vars.size());
-    /* iterate through all possible variable arrangements */
-    for (ipdiff::ivectors::const_iterator ait=arrs.begin();ait!=arrs.end();++ait) {
-        const ipdiff::ivector &arr=*ait;
-        for (ipdiff::ivector::const_iterator it=arr.begin();it!=arr.end();++it) {
-            tmp_vars[it-arr.begin()]=vars[*it];
+        vecteur tmp_vars(vars.size());
+        /* iterate through all possible variable arrangements */
+        for (ipdiff::ivectors::const_iterator ait=arrs.begin();ait!=arrs.end();++ait) {
+            if (budget.exceeded())
+                break;
+            const ipdiff::ivector &arr=*ait;
+            for (ipdiff::ivector::const_iterator it=arr.begin();it!=arr.end();++it) {
+                tmp_vars[it-arr.begin()]=vars[*it];
+            }
+            find_local_extrema(cpts,gv[0],constr,tmp_vars,arr,ineq,initial,order_size,&budget,contextptr);
+        }
+        vecteur pairs;
+        for (gen_map::const_iterator it=cpts.begin();it!=cpts.end();++it) {
+            pairs.push_back(makevecteur(it->first,it->second));
         }
-        find_local_extrema(cpts,gv[0],constr,tmp_vars,arr,ineq,initial,order_size,contextptr);
+        // incomplete results are not cached
+        if (budget.get_status()==opt_budget::_OPT_BUDGET_OK)
+            optcache::instance().store(key,pairs);
+        else *logptr(contextptr) << "Warning: the budget was exceeded, some critical points may be missing" << endl;
     }
     if (order_size==1) { // return the list of critical points
         vecteur cv;
         for (gen_map::const_iterator it=cpts.begin();it!=cpts.end();++it) {
             cv.push_back(it->first);
         }
+        if (budget.get_status()!=opt_budget::_OPT_BUDGET_OK)
+            return makesequence(cv,budget.flag());
         return cv;
     }
     // return sequence of minima and maxima in separate lists and report non- or possible extrema
@@ -1699,6 +2178,8 @@ gen _extrema(const gen &g,GIAC_CONTEXT) {
             break;
         }
     }
+    if (budget.get_status()!=opt_budget::_OPT_BUDGET_OK)
+        return makesequence(minv,maxv,budget.flag());
     return makesequence(minv,maxv);
 }
 static const char _extrema_s []="extrema";
@@ -1718,6 +2199,7 @@ gen compf(const gen &f,identificateur &x,gen &a,bool absolute,GIAC_CONTEXT) {
  * find zero of expression f(x) for x in [a,b] using Brent solver
  */
 gen find_zero(const gen &f,identificateur &x,gen &a,gen &b,GIAC_CONTEXT) {
+    opt_timer timer("find_zero");
     gen I(symb_interval(a,b));
     gen var(symb_equal(x,I));
     vecteur sol(*_fsolve(makesequence(f,var,_BRENT_SOLVER),contextptr)._VECTptr);
@@ -1729,6 +2211,7 @@ gen find_zero(const gen &f,identificateur &x,gen &a,gen &b,GIAC_CONTEXT) {
  * golden-section search.
  */
 gen find_peak(const gen &f,identificateur &x,gen &a_orig,gen &b_orig,GIAC_CONTEXT) {
+    opt_timer timer("find_peak");
     gen a(a_orig),b(b_orig);
     gen c(b-(b-a)/GOLDEN_RATIO),d(a+(b-a)/GOLDEN_RATIO);
     while (is_strictly_greater(_abs(c-d,contextptr),epsilon(contextptr),contextptr)) {
@@ -1787,7 +2270,11 @@ vecteur chebyshev_nodes(gen &a,gen &b,int n,GIAC_CONTEXT) {
  * this implementation.
  *
  * In 'opts' one may specify 'limit=<posint>' which limits the number of
- * iterations. By default, it is unlimited.
+ * iterations. By default, it is unlimited. The options 'timeout=<seconds>' and
+ * 'maxcandidates=<posint>' limit the running time and the number of Remez
+ * iterations. They are checked after each iteration. When one of these limits
+ * is reached before convergence, the best polynomial found so far is returned,
+ * followed by the name of the option.
  *
  * Be aware that, in some cases, the result with high n may be unsatisfying,
  * producing larger error than the polynomials for smaller n. This happens
@@ -1811,6 +2298,7 @@ vecteur chebyshev_nodes(gen &a,gen &b,int n,GIAC_CONTEXT) {
  */
 gen _minimax(const gen &g,GIAC_CONTEXT) {
     if (g.type==_STRNG && g.subtype==-1) return g;
+    opt_timer timer("minimax");
     if (g.type!=_VECT || g.subtype!=_SEQ__VECT)
         return gentypeerr(contextptr);
     vecteur &gv=*g._VECTptr;
@@ -1832,6 +2320,7 @@ gen _minimax(const gen &g,GIAC_CONTEXT) {
     gen threshold(1.02);  // threshold for stopping criterion
     // detect options
     int limit=0;
+    opt_budget budget;
     //bool poly=true;
     for (const_iterateur it=gv.begin()+3;it!=gv.end();++it) {
         if (it->is_symb_of_sommet(at_equal)) {
@@ -1840,7 +2329,8 @@ gen _minimax(const gen &g,GIAC_CONTEXT) {
                 if (!is_integer(p[1]) || !is_strictly_positive(p[1],contextptr))
                     return gentypeerr(contextptr);
                 limit=p[1].val;
-            }
+            } else if (!budget.parse_option(*it,contextptr))
+                return gentypeerr(contextptr);
         }
         else if (is_integer(*it)) {
             switch (it->val) {
@@ -1922,8 +2412,15 @@ gen _minimax(const gen &g,GIAC_CONTEXT) {
                 is_greater(threshold*emin,emax,contextptr)) {
             break;
         }
+        // each iteration yields a candidate polynomial
+        if (budget.add_candidates())
+            break;
     }
     *logptr(contextptr) << "max. absolute error: " << best_emax << endl;
+    if (budget.get_status()!=opt_budget::_OPT_BUDGET_OK) {
+        *logptr(contextptr) << "Warning: the budget was exceeded before convergence" << endl;
+        return makesequence(best_p,budget.flag());
+    }
     return best_p;
 }
 static const char _minimax_s []="minimax";
@@ -1949,6 +2446,7 @@ tprob::tprob(const vecteur &s,const vecteur &d,const gen &m,GIAC_CONTEXT) {
  * solutions).
  */
 void tprob::north_west_corner(matrice &feas) {
+    opt_timer timer("tprob::north_west_corner");
     feas.clear();
     int m=supply.size(),n=demand.size();
     for (int k=0;k<m;++k) {
@@ -2006,9 +2504,11 @@ tprob::ipairs tprob::stepping_stone_path(ipairs &path_orig,const matrice &X) {
 
 /*
  * Implementation of MODI (modified ditribution) method. It handles degenerate
- * solutions if they appear during the process.
+ * solutions if they appear during the process. Each visited basic feasible
+ * solution counts as a candidate for the budget.
  */
-void tprob::modi(const matrice &P_orig,matrice &X) {
+void tprob::modi(const matrice &P_orig,matrice &X,opt_budget *budget) {
+    opt_timer timer("tprob::modi");
     matrice P(P_orig);
     int m=X.size(),n=X.front()._VECTptr->size();
     vecteur u(m),v(n);
@@ -2056,7 +2556,7 @@ void tprob::modi(const matrice &P_orig,matrice &X) {
                 }
             }
         }
-        if (optimal)
+        if (optimal || (budget!=NULL && budget->add_candidates()))
             break;
         ipairs path;
         path.push_back(make_pair(I,J));
@@ -2084,9 +2584,9 @@ void tprob::modi(const matrice &P_orig,matrice &X) {
     X=*exact(_epsilon2zero(_evalf(X,ctx),ctx),ctx)._VECTptr;
 }
 
-void tprob::solve(const matrice &cost_matrix,matrice &sol) {
+void tprob::solve(const matrice &cost_matrix,matrice &sol,opt_budget *budget) {
     north_west_corner(sol);
-    modi(cost_matrix,sol);
+    modi(cost_matrix,sol,budget);
 }
 
 /*
@@ -2098,7 +2598,7 @@ void tprob::solve(const matrice &cost_matrix,matrice &sol) {
  *
  * Usage
  * ^^^^^
- *      tpsolve(supply,demand,cost_matrix)
+ *      tpsolve(supply,demand,cost_matrix,[budget])
  *
  * Parameters
  * ^^^^^^^^^^
@@ -2107,6 +2607,8 @@ void tprob::solve(const matrice &cost_matrix,matrice &sol) {
  *      - cost_matrix : real matrix C=[c_ij] of type mXn where c_ij is cost of
  *                      transporting an unit from ith source to jth destination
  *                      (a nonnegative number)
+ *      - budget      : 'timeout=<seconds>' and/or 'maxcandidates=<posint>'
+ *                      (optional)
  *
  * Supply and demand vectors should contain only positive integers. Cost matrix
  * must be consisted of nonnegative real numbers, which do not have to be
@@ -2129,6 +2631,11 @@ void tprob::solve(const matrice &cost_matrix,matrice &sol) {
  * problem, augmenting the cost matrix with zeros. Resulting matrix will not
  * contain dummy point.
  *
+ * The options 'timeout' and 'maxcandidates' limit the running time and the
+ * number of basic feasible solutions visited by the MODI method. When one of
+ * the limits is reached, the current feasible solution is returned, followed
+ * by the name of the option whose limit was reached.
+ *
  * Examples
  * ^^^^^^^^
  * Balanced transportation problem:
@@ -2146,11 +2653,17 @@ void tprob::solve(const matrice &cost_matrix,matrice &sol) {
  */
 gen _tpsolve(const gen &g,GIAC_CONTEXT) {
     if (g.type==_STRNG && g.subtype==-1) return g;
+    opt_timer timer("tpsolve");
     if (g.type!=_VECT || g.subtype!=_SEQ__VECT)
         return gentypeerr(contextptr);
     vecteur &gv=*g._VECTptr;
     if (gv.size()<3)
         return gensizeerr(contextptr);
+    opt_budget budget;
+    for (const_iterateur it=gv.begin()+3;it!=gv.end();++it) {
+        if (!budget.parse_option(*it,contextptr))
+            return gensizeerr(contextptr);
+    }
     if (gv[0].type!=_VECT || gv[1].type!=_VECT ||
             gv[2].type!=_VECT || !ckmatrix(*gv[2]._VECTptr))
         return gentypeerr(contextptr);
@@ -2177,7 +2690,7 @@ gen _tpsolve(const gen &g,GIAC_CONTEXT) {
     }
     matrice X;
     tprob tp(supply,demand,M,contextptr);
-    tp.solve(P,X);
+    tp.solve(P,X,&budget);
     if (is_strictly_greater(ts,td,contextptr)) {
         X=mtran(X);
         X.pop_back();
@@ -2191,32 +2704,288 @@ gen _tpsolve(const gen &g,GIAC_CONTEXT) {
             cost+=P[i][j]*X[i][j];
         }
     }
+    if (budget.get_status()!=opt_budget::_OPT_BUDGET_OK) {
+        *logptr(contextptr) << "Warning: the budget was exceeded, the solution may not be optimal" << endl;
+        return makesequence(cost,X,budget.flag());
+    }
     return makesequence(cost,X);
 }
 static const char _tpsolve_s []="tpsolve";
 static define_unary_function_eval (__tpsolve,&_tpsolve,_tpsolve_s);
 define_unary_function_ptr5(at_tpsolve,alias_at_tpsolve,&__tpsolve,0,true)
 
-gen compute_invdiff(int n,int k,vecteur &xv,vecteur &yv,map<tprob::ipair,gen> &invdiff,GIAC_CONTEXT) {
-    tprob::ipair I=make_pair(n,k);
-    assert(n<=k);
-    gen res(invdiff[I]);
-    if (!is_zero(res))
-        return res;
-    if (n==0)
-        return invdiff[I]=yv[k];
-    if (n==1)
-        return invdiff[I]=(xv[k]-xv[0])/(yv[k]-yv[0]);
-    gen d1(compute_invdiff(n-1,n-1,xv,yv,invdiff,contextptr));
-    gen d2(compute_invdiff(n-1,k,xv,yv,invdiff,contextptr));
-    return invdiff[I]=(xv[k]-xv[n-1])/(d2-d1);
+/*
+ * Convert the elements of v to doubles. Return false if some of them do not
+ * evaluate to a real number.
+ */
+bool vecteur2doubles(const vecteur &v,vector<double> &d,GIAC_CONTEXT) {
+    d.resize(v.size());
+    gen e;
+    for (const_iterateur it=v.begin();it!=v.end();++it) {
+        if ((e=_evalf(*it,contextptr)).type!=_DOUBLE_)
+            return false;
+        d[it-v.begin()]=e.DOUBLE_val();
+    }
+    return true;
+}
+
+/*
+ * Return the position of the reciprocal difference phi_i(x_k), i<=k, in the
+ * flat triangular table for n points (the ith row holds n-i entries).
+ */
+inline int invdiff_index(int n,int i,int k) {
+    return i*n-(i*(i-1))/2+k-i;
+}
+
+/*
+ * Compute the coefficients a[0],a[1],...,a[n-1] of Thiele's continued fraction
+ * for the points (xv[k],yv[k]), k=0,1,..,n-1, i.e. the diagonal entries
+ * a[i]=phi_i(x_i) of the table of reciprocal differences
+ *
+ *      phi_0(x_k)=y_k,  phi_i(x_k)=(x_k-x_(i-1))/(phi_(i-1)(x_k)-phi_(i-1)(x_(i-1))).
+ *
+ * The table is filled row by row in O(n^2) operations. Entries with vanishing
+ * denominator are infinite and therefore left uncomputed, which is recorded in
+ * the bitmask 'computed'; the entries depending on exactly one of them are zero.
+ * Return false if some of the coefficients is infinite or undefined.
+ */
+bool thiele_coeffs(const vecteur &xv,const vecteur &yv,vecteur &a,GIAC_CONTEXT) {
+    opt_timer timer("thiele_coeffs");
+    int n=xv.size();
+    vecteur tbl((n*(n+1))/2,0);
+    vector<bool> computed(tbl.size(),false);
+    for (int k=0;k<n;++k) {
+        tbl[k]=yv[k];
+        computed[k]=true;
+    }
+    gen d;
+    for (int i=1;i<n;++i) {
+        int pd=invdiff_index(n,i-1,i-1);
+        for (int k=i;k<n;++k) {
+            int p=invdiff_index(n,i-1,k),q=invdiff_index(n,i,k);
+            if (computed[p]!=computed[pd])
+                computed[q]=true;
+            else if (computed[p] && !is_zero(d=tbl[p]-tbl[pd])) {
+                tbl[q]=(xv[k]-xv[i-1])/d;
+                computed[q]=true;
+            }
+        }
+    }
+    a.resize(n);
+    for (int i=0;i<n;++i) {
+        int q=invdiff_index(n,i,i);
+        if (!computed[q])
+            return false;
+        a[i]=tbl[q];
+    }
+    return true;
+}
+
+/*
+ * Numeric version of 'thiele_coeffs' operating on doubles.
+ */
+bool thiele_coeffs(const vector<double> &xv,const vector<double> &yv,vector<double> &a) {
+    opt_timer timer("thiele_coeffs");
+    int n=xv.size();
+    vector<double> tbl((n*(n+1))/2,0);
+    vector<bool> computed(tbl.size(),false);
+    for (int k=0;k<n;++k) {
+        tbl[k]=yv[k];
+        computed[k]=true;
+    }
+    double d;
+    for (int i=1;i<n;++i) {
+        int pd=invdiff_index(n,i-1,i-1);
+        for (int k=i;k<n;++k) {
+            int p=invdiff_index(n,i-1,k),q=invdiff_index(n,i,k);
+            if (computed[p]!=computed[pd])
+                computed[q]=true;
+            else if (computed[p] && (d=tbl[p]-tbl[pd])!=0) {
+                tbl[q]=(xv[k]-xv[i-1])/d;
+                computed[q]=true;
+            }
+        }
+    }
+    a.resize(n);
+    for (int i=0;i<n;++i) {
+        int q=invdiff_index(n,i,i);
+        if (!computed[q] || !std::isfinite(tbl[q]))
+            return false;
+        a[i]=tbl[q];
+    }
+    return true;
+}
+
+/*
+ * Evaluate Thiele's continued fraction with coefficients a at the points t by
+ * backward recurrence, simultaneously for all points. The values at poles are
+ * infinite.
+ */
+void thiele_eval(const vector<double> &a,const vector<double> &xv,const vector<double> &t,vector<double> &res) {
+    int m=t.size();
+    res.assign(m,0.0);
+    for (int k=a.size();k-->1;) {
+        double xk=xv[k-1],ak=a[k];
+        for (int j=0;j<m;++j) {
+            res[j]=(t[j]-xk)/(ak+res[j]);
+        }
+    }
+    for (int j=0;j<m;++j) {
+        res[j]+=a.front();
+    }
+}
+
+/*
+ * Find all complex roots of the polynomial with coefficients c, where c[i] is
+ * the coefficient of x^i, using the Aberth-Ehrlich method. The leading
+ * coefficient must be nonzero. Return false if the iteration did not converge.
+ */
+bool aberth_roots(const vector<double> &c,vector<complex<double> > &roots,int maxiter=500) {
+    int n=c.size()-1;
+    roots.resize(std::max(n,0));
+    if (n<1)
+        return true;
+    double r=0;
+    for (int i=0;i<n;++i) {
+        r=std::max(r,std::pow(std::abs(c[i]/c[n]),1.0/(n-i)));
+    }
+    if (r==0)
+        r=1;
+    for (int k=0;k<n;++k) {
+        roots[k]=std::polar(r,(2*M_PI*k+0.4)/n);
+    }
+    complex<double> p,dp,s,w;
+    for (int iter=0;iter<maxiter;++iter) {
+        bool converged=true;
+        for (int k=0;k<n;++k) {
+            const complex<double> &z=roots[k];
+            p=c[n];
+            dp=0;
+            for (int i=n;i-->0;) {
+                dp=dp*z+p;
+                p=p*z+c[i];
+            }
+            if (p==0.0)
+                continue;
+            s=0;
+            for (int j=0;j<n;++j) {
+                if (j!=k)
+                    s+=1.0/(z-roots[j]);
+            }
+            w=p/dp;
+            w/=1.0-w*s;
+            roots[k]-=w;
+            if (std::abs(w)>1e-14*(1+std::abs(roots[k])))
+                converged=false;
+        }
+        if (converged)
+            return true;
+    }
+    return false;
+}
+
+/*
+ * Compute the real poles in [min(xv),max(xv)] of Thiele's continued fraction
+ * with coefficients a. The fraction is converted to the quotient of two
+ * polynomials in the variable u=(x-c)/s, where c is the center and s the
+ * half-width of the data range, by backward recurrence on the coefficient
+ * arrays. The poles are found among the roots of the denominator; the roots
+ * which are also roots of the numerator are discarded. Return false if the
+ * root finder did not converge.
+ */
+bool thiele_poles(const vector<double> &a,const vector<double> &xv,vector<double> &poles) {
+    poles.clear();
+    double lo=*std::min_element(xv.begin(),xv.end()),hi=*std::max_element(xv.begin(),xv.end());
+    double c=(lo+hi)/2,s=(hi-lo)/2;
+    if (s==0)
+        return true;
+    vector<double> P(1,0.0),Q(1,1.0),t;
+    for (int k=a.size();k-->1;) {
+        // (P,Q) := ((x-x_(k-1))*Q,a_k*Q+P)
+        double u=(xv[k-1]-c)/s,nrm=0;
+        t.assign(Q.size()+1,0.0);
+        for (int i=0;i<int(Q.size());++i) {
+            t[i+1]+=s*Q[i];
+            t[i]-=s*u*Q[i];
+        }
+        Q.resize(std::max(Q.size(),P.size()),0.0);
+        for (int i=0;i<int(Q.size());++i) {
+            Q[i]=a[k]*Q[i]+(i<int(P.size())?P[i]:0.0);
+            nrm=std::max(nrm,std::abs(Q[i]));
+        }
+        P.swap(t);
+        if (nrm==0)
+            return false;
+        for (int i=0;i<int(P.size());++i) P[i]/=nrm;
+        for (int i=0;i<int(Q.size());++i) Q[i]/=nrm;
+    }
+    // numerator N=a_0*Q+P
+    vector<double> N(std::max(P.size(),Q.size()),0.0);
+    for (int i=0;i<int(N.size());++i) {
+        N[i]=(i<int(Q.size())?a.front()*Q[i]:0.0)+(i<int(P.size())?P[i]:0.0);
+    }
+    double qmax=0;
+    for (int i=0;i<int(Q.size());++i) {
+        qmax=std::max(qmax,std::abs(Q[i]));
+    }
+    while (Q.size()>1 && std::abs(Q.back())<=1e-14*qmax) {
+        Q.pop_back();
+    }
+    vector<complex<double> > roots;
+    if (!aberth_roots(Q,roots))
+        return false;
+    for (vector<complex<double> >::const_iterator it=roots.begin();it!=roots.end();++it) {
+        double u=it->real();
+        if (std::abs(it->imag())>1e-8*(1+std::abs(u)) || u<-1 || u>1)
+            continue;
+        double nu=0,nabs=0;
+        for (int i=N.size();i-->0;) {
+            nu=nu*u+N[i];
+            nabs=nabs*std::abs(u)+std::abs(N[i]);
+        }
+        if (std::abs(nu)<=1e-8*nabs)
+            continue; // common root of numerator and denominator
+        poles.push_back(c+s*u);
+    }
+    std::sort(poles.begin(),poles.end());
+    return true;
 }
 
-gen thiele(int k,vecteur &xv,vecteur &yv,identificateur &var,map<tprob::ipair,gen> &invdiff,GIAC_CONTEXT) {
-    if (k==int(xv.size()))
-        return gen(0);
-    gen phi(compute_invdiff(k,k,xv,yv,invdiff,contextptr));
-    return (var-xv[k-1])/(phi+thiele(k+1,xv,yv,var,invdiff,contextptr));
+/*
+ * Build Thiele's continued fraction with coefficients a in variable var,
+ * starting from the innermost term. If var is a number, the value of the
+ * fraction at var is obtained.
+ */
+gen thiele(const vecteur &a,const vecteur &xv,const gen &var) {
+    gen r(0);
+    for (int k=a.size();k-->1;) {
+        r=(var-xv[k-1])/(a[k]+r);
+    }
+    return a.front()+r;
+}
+
+/*
+ * Parse the data points given either as a list of points (two-column matrix)
+ * or as two lists of coordinates at the beginning of the argument list gv.
+ * Store the coordinates to xv and yv and return the index of the first
+ * argument following the data, or -1 if the data is invalid.
+ */
+int parse_xydata(const vecteur &gv,vecteur &xv,vecteur &yv) {
+    if (gv.empty() || gv.front().type!=_VECT)
+        return -1;
+    if (ckmatrix(gv.front())) {
+        matrice m(mtran(*gv.front()._VECTptr));
+        if (m.size()!=2)
+            return -1;
+        xv=*m[0]._VECTptr;
+        yv=*m[1]._VECTptr;
+        return xv.empty()?-1:1;
+    }
+    if (gv.size()<2 || gv[1].type!=_VECT || gv[0]._VECTptr->size()!=gv[1]._VECTptr->size())
+        return -1;
+    xv=*gv[0]._VECTptr;
+    yv=*gv[1]._VECTptr;
+    return xv.empty()?-1:2;
 }
 
 /*
@@ -2233,15 +3002,22 @@ gen thiele(int k,vecteur &xv,vecteur &yv,identificateur &var,map<tprob::ipair,ge
  * Parameters
  * ^^^^^^^^^^
  *      - data      : list of points [[x1,y1],[x2,y2],...,[xn,yn]]
- *      - v         : identifier (may be any symbolic expression)
+ *      - v         : identifier (may be any symbolic expression), number or
+ *                    list of numbers
  *      - data_x    : list of x coordinates [x1,x2,...,xn]
  *      - data_y    : list of y coordinates [y1,y2,...,yn]
  *
  * The return value is an expression R(v), where R is rational interpolant of
- * the given set of points.
+ * the given set of points. If v is a number or a list of numbers, the
+ * continued fraction is evaluated directly at v by backward recurrence,
+ * without constructing R in normal form. This is the preferred way to use the
+ * interpolant of a large set of points.
  *
  * Note that the interpolant may have singularities in
- * [min(data_x),max(data_x)].
+ * [min(data_x),max(data_x)]. If the data is numeric, their locations are
+ * determined from the roots of the denominator and reported in a warning.
+ * Otherwise, the intervals between nodes in which the denominator changes
+ * sign are reported.
  *
  * Example
  * ^^^^^^^
@@ -2259,56 +3035,92 @@ gen thiele(int k,vecteur &xv,vecteur &yv,identificateur &var,map<tprob::ipair,ge
  *      (-1.55286115659*x^6+5.87298387514*x^5-5.4439152812*x^4+1.68655817708*x^3
  *       -2.40784868317*x^2-7.55954205222*x+9.40462512097)/(x^6-1.24295718965*x^5
  *       -1.33526268624*x^4+4.03629272425*x^3-0.885419321*x^2-2.77913222418*x+3.45976823393)
+ * To evaluate the interpolant at x=0.1 and x=1.9, input:
+ *      thiele(data_x,data_y,[0.1,1.9])
  */
 gen _thiele(const gen &g,GIAC_CONTEXT) {
     if (g.type==_STRNG && g.subtype==-1) return g;
+    opt_timer timer("thiele");
     if (g.type!=_VECT || g.subtype!=_SEQ__VECT)
         return gentypeerr(contextptr);
     vecteur &gv=*g._VECTptr;
     if (gv.size()<2)
         return gensizeerr(contextptr);
-    vecteur xv,yv;
-    gen x;
     if (gv[0].type!=_VECT)
         return gentypeerr(contextptr);
-    if (ckmatrix(gv[0])) {
-        matrice m(mtran(*gv[0]._VECTptr));
-        if (m.size()!=2)
-            return gensizeerr(contextptr);
-        xv=*m[0]._VECTptr;
-        yv=*m[1]._VECTptr;
-        x=gv[1];
+    vecteur xv,yv;
+    int ai=parse_xydata(gv,xv,yv);
+    if (ai<0 || ai>=int(gv.size()))
+        return gensizeerr(contextptr);
+    gen x=gv[ai];
+    vecteur a;
+    vector<double> dxv,dyv,da;
+    bool ok;
+    if ((is_approx(xv) || is_approx(yv)) &&
+            vecteur2doubles(xv,dxv,contextptr) && vecteur2doubles(yv,dyv,contextptr)) {
+        // numeric data, compute the reciprocal differences in floating-point arithmetic
+        if ((ok=thiele_coeffs(dxv,dyv,da))) {
+            a.resize(da.size());
+            for (int i=0;i<int(da.size());++i) {
+                a[i]=gen(da[i]);
+            }
+        }
+    } else ok=thiele_coeffs(xv,yv,a,contextptr);
+    if (!ok) {
+        *logptr(contextptr) << "Error: the given points do not admit a Thiele interpolant" << endl;
+        return undef;
     }
-    else {
-        if (gv[1].type!=_VECT)
-            return gentypeerr(contextptr);
-        if (gv[0]._VECTptr->size()!=gv[1]._VECTptr->size())
-            return gensizeerr(contextptr);
-        xv=*gv[0]._VECTptr;
-        yv=*gv[1]._VECTptr;
-        x=gv[2];
+    if (x.type==_VECT || (x.type!=_IDNT && _evalf(x,contextptr).type==_DOUBLE_)) {
+        // evaluate the continued fraction at the given point(s)
+        vecteur q(x.type==_VECT?*x._VECTptr:vecteur(1,x)),val(q.size());
+        vector<double> dq,dval;
+        if (!da.empty() && vecteur2doubles(q,dq,contextptr)) {
+            thiele_eval(da,dxv,dq,dval);
+            for (int i=0;i<int(dval.size());++i) {
+                val[i]=gen(dval[i]);
+            }
+        } else for (int i=0;i<int(q.size());++i) { // exact evaluation, simplify the result
+            val[i]=ratnormal(_simplify(thiele(a,xv,q[i]),contextptr),contextptr);
+        }
+        return x.type==_VECT?gen(val):val.front();
     }
     gen var(x.type==_IDNT?x:identificateur(" x"));
-    map<tprob::ipair,gen> invdiff;
-    gen rat(yv[0]+thiele(1,xv,yv,*var._IDNTptr,invdiff,contextptr));
+    gen rat(thiele(a,xv,var));
     if (x.type==_IDNT) {
         // detect singularities
-        gen den(_denom(rat,contextptr));
-        matrice sing;
-        if (*_lname(den,contextptr)._VECTptr==vecteur(1,x)) {
-            for (int i=0;i<int(xv.size())-1;++i) {
-                gen y1(_evalf(subst(den,x,xv[i],false,contextptr),contextptr));
-                gen y2(_evalf(subst(den,x,xv[i+1],false,contextptr),contextptr));
-                if (is_positive(-y1*y2,contextptr))
-                    sing.push_back(makevecteur(xv[i],xv[i+1]));
-            }
-        }
-        if (!sing.empty()) {
-            *logptr(contextptr) << "Warning, the interpolant has singularities in ";
-            for (int i=0;i<int(sing.size());++i) {
-                *logptr(contextptr) << "(" << sing[i][0] << "," << sing[i][1] << ")";
-                if (i<int(sing.size())-1)
-                    *logptr(contextptr) << (i<int(sing.size())-2?", ":" and ");
+        vector<double> poles;
+        if ((!dxv.empty() || vecteur2doubles(xv,dxv,contextptr)) &&
+                (!da.empty() || vecteur2doubles(a,da,contextptr))) {
+            if (!thiele_poles(da,dxv,poles))
+                *logptr(contextptr) << "Warning, failed to locate the singularities of the interpolant" << endl;
+        } else {
+            // non-numeric data, detect sign changes of the denominator between the nodes
+            gen den(_denom(ratnormal(rat,contextptr),contextptr));
+            matrice sing;
+            if (*_lname(den,contextptr)._VECTptr==vecteur(1,x)) {
+                for (int i=0;i<int(xv.size())-1;++i) {
+                    gen y1(_evalf(subst(den,x,xv[i],false,contextptr),contextptr));
+                    gen y2(_evalf(subst(den,x,xv[i+1],false,contextptr),contextptr));
+                    if (is_positive(-y1*y2,contextptr))
+                        sing.push_back(makevecteur(xv[i],xv[i+1]));
+                }
+            }
+            if (!sing.empty()) {
+                *logptr(contextptr) << "Warning, the interpolant has singularities in ";
+                for (int i=0;i<int(sing.size());++i) {
+                    *logptr(contextptr) << "(" << sing[i][0] << "," << sing[i][1] << ")";
+                    if (i<int(sing.size())-1)
+                        *logptr(contextptr) << (i<int(sing.size())-2?", ":" and ");
+                }
+                *logptr(contextptr) << endl;
+            }
+        }
+        if (!poles.empty()) {
+            *logptr(contextptr) << "Warning, the interpolant has singularities at " << x << "=";
+            for (int i=0;i<int(poles.size());++i) {
+                *logptr(contextptr) << poles[i];
+                if (i<int(poles.size())-1)
+                    *logptr(contextptr) << (i<int(poles.size())-2?", ":" and ");
             }
             *logptr(contextptr) << endl;
         }
@@ -2321,27 +3133,1907 @@ static const char _thiele_s []="thiele";
 static define_unary_function_eval (__thiele,&_thiele,_thiele_s);
 define_unary_function_ptr5(at_thiele,alias_at_thiele,&__thiele,0,true)
 
+/*
+ * Compute the right singular vector v corresponding to the smallest singular
+ * value of the m-by-n matrix A, stored by columns. A is reduced to the
+ * triangular factor R by Householder QR decomposition (it is overwritten in
+ * the process) and the SVD of R is computed by one-sided Jacobi rotations.
+ */
+void smallest_right_singular_vector(vector<double> &A,int m,int n,vector<double> &v) {
+    vector<double> R(n*n,0.0),V(n*n,0.0);
+    for (int k=0;k<n && k<m;++k) {
+        double *ak=&A[k*m],nrm=0,vnrm=0,dot;
+        for (int i=k;i<m;++i) nrm+=ak[i]*ak[i];
+        if ((nrm=std::sqrt(nrm))==0)
+            continue;
+        double alpha=ak[k]>0?-nrm:nrm;
+        ak[k]-=alpha;
+        for (int i=k;i<m;++i) vnrm+=ak[i]*ak[i];
+        for (int j=k+1;j<n;++j) {
+            double *aj=&A[j*m];
+            dot=0;
+            for (int i=k;i<m;++i) dot+=ak[i]*aj[i];
+            dot*=2/vnrm;
+            for (int i=k;i<m;++i) aj[i]-=dot*ak[i];
+        }
+        R[k*n+k]=alpha;
+    }
+    for (int j=0;j<n;++j) {
+        for (int i=0;i<j && i<m;++i) {
+            R[j*n+i]=A[j*m+i];
+        }
+        V[j*n+j]=1;
+    }
+    for (int sweep=0;sweep<100;++sweep) {
+        bool rotated=false;
+        for (int p=0;p<n;++p) {
+            for (int q=p+1;q<n;++q) {
+                double *rp=&R[p*n],*rq=&R[q*n],*vp=&V[p*n],*vq=&V[q*n];
+                double alpha=0,beta=0,gamma=0;
+                for (int i=0;i<n;++i) {
+                    alpha+=rp[i]*rp[i];
+                    beta+=rq[i]*rq[i];
+                    gamma+=rp[i]*rq[i];
+                }
+                if (std::abs(gamma)<=1e-15*std::sqrt(alpha*beta))
+                    continue;
+                rotated=true;
+                double zeta=(beta-alpha)/(2*gamma);
+                double t=(zeta>=0?1.0:-1.0)/(std::abs(zeta)+std::sqrt(1+zeta*zeta));
+                double c=1/std::sqrt(1+t*t),s=c*t,tmp;
+                for (int i=0;i<n;++i) {
+                    tmp=rp[i];
+                    rp[i]=c*tmp-s*rq[i];
+                    rq[i]=s*tmp+c*rq[i];
+                    tmp=vp[i];
+                    vp[i]=c*tmp-s*vq[i];
+                    vq[i]=s*tmp+c*vq[i];
+                }
+            }
+        }
+        if (!rotated)
+            break;
+    }
+    int kmin=0;
+    double smin=-1;
+    for (int k=0;k<n;++k) {
+        double sk=0;
+        for (int i=0;i<n;++i) sk+=R[k*n+i]*R[k*n+i];
+        if (smin<0 || sk<smin) {
+            smin=sk;
+            kmin=k;
+        }
+    }
+    v.assign(V.begin()+kmin*n,V.begin()+(kmin+1)*n);
+}
+
+/*
+ * AAA (adaptive Antoulas-Anderson) algorithm for rational approximation of the
+ * data (zv[i],fv[i]), i=1,2,..,M, in barycentric form
+ *
+ *      r(x)=sum(w[j]*sf[j]/(x-sz[j]),j=0..m-1)/sum(w[j]/(x-sz[j]),j=0..m-1).
+ *
+ * The support points sz are chosen greedily among zv where the error of the
+ * current approximation is the largest. The weights w span the numerical null
+ * space of the Loewner matrix [(fv[i]-sf[j])/(zv[i]-sz[j])] restricted to the
+ * remaining points. The iteration stops when the maximal error is below
+ * tol*max|fv| or when the degree m-1 reaches maxdeg. The abscissas must be
+ * distinct. Since noisy data may cause spurious poles in later iterations,
+ * the approximation with the smallest error is returned. Return the maximal
+ * absolute error at the data points.
+ */
+double aaa(const vector<double> &zv,const vector<double> &fv,double tol,int maxdeg,
+           vector<double> &sz,vector<double> &sf,vector<double> &w) {
+    int M=zv.size();
+    double fmax=0,fmean=0,err=0;
+    for (int i=0;i<M;++i) {
+        fmax=std::max(fmax,std::abs(fv[i]));
+        fmean+=fv[i];
+    }
+    sz.clear();
+    sf.clear();
+    w.assign(1,1.0);
+    if (M<2) {
+        sz=zv;
+        sf=fv;
+        return 0;
+    }
+    vector<double> R(M,fmean/M),A,Q,wm,best_w,best_sz,best_sf;
+    vector<bool> support(M,false);
+    vector<int> rest(M); // indices of the rows of the Loewner matrix A, which is stored by columns
+    for (int i=0;i<M;++i) rest[i]=i;
+    double best_err=-1;
+    for (int m=1;m<=maxdeg+1 && m<M;++m) {
+        int j=0,p=0;
+        double emax=-1,e;
+        for (int r=0;r<M-m+1;++r) {
+            if ((e=std::abs(fv[rest[r]]-R[rest[r]]))>emax) {
+                emax=e;
+                p=r;
+            }
+        }
+        j=rest[p];
+        support[j]=true;
+        sz.push_back(zv[j]);
+        sf.push_back(fv[j]);
+        // remove the row of the new support point in place and append the new column
+        int rows=M-m;
+        for (int k=0;k<m-1;++k) {
+            for (int r=0;r<rows;++r) {
+                A[k*rows+r]=A[k*(rows+1)+(r<p?r:r+1)];
+            }
+        }
+        rest.erase(rest.begin()+p);
+        A.resize(rows*m);
+        for (int r=0;r<rows;++r) {
+            A[(m-1)*rows+r]=(fv[rest[r]]-fv[j])/(zv[rest[r]]-zv[j]);
+        }
+        Q.assign(A.begin(),A.end()); // overwritten by the factorization
+        smallest_right_singular_vector(Q,rows,m,wm);
+        err=0;
+        for (int i=0;i<M;++i) {
+            if (support[i]) {
+                R[i]=fv[i];
+                continue;
+            }
+            double num=0,den=0,c;
+            for (int k=0;k<m;++k) {
+                c=wm[k]/(zv[i]-sz[k]);
+                num+=c*sf[k];
+                den+=c;
+            }
+            R[i]=num/den;
+            err=std::max(err,std::abs(fv[i]-R[i]));
+        }
+        if (best_err<0 || err<best_err) {
+            best_err=err;
+            best_sz=sz;
+            best_sf=sf;
+            best_w=wm;
+        }
+        if (err<=tol*fmax)
+            break;
+    }
+    sz.swap(best_sz);
+    sf.swap(best_sf);
+    w.swap(best_w);
+    return best_err;
+}
+
+/*
+ * Evaluate the rational function in barycentric form (sz,sf,w) at the points
+ * t by using the formula from 'aaa'.
+ */
+void aaa_eval(const vector<double> &sz,const vector<double> &sf,const vector<double> &w,
+              const vector<double> &t,vector<double> &res) {
+    int m=sz.size(),n=t.size();
+    res.resize(n);
+    for (int i=0;i<n;++i) {
+        double num=0,den=0,c;
+        int k=0;
+        for (;k<m;++k) {
+            if (t[i]==sz[k])
+                break;
+            c=w[k]/(t[i]-sz[k]);
+            num+=c*sf[k];
+            den+=c;
+        }
+        res[i]=k<m?sf[k]:num/den;
+    }
+}
+
+/*
+ * 'aaa' computes a rational approximation of the given set of points by using
+ * the AAA (adaptive Antoulas-Anderson) algorithm. Unlike 'thiele', it does not
+ * interpolate all points, which makes it suitable for large and noisy data.
+ *
+ * Source: Y. Nakatsukasa, O. Sete and L. N. Trefethen, The AAA algorithm for
+ *         rational approximation, SIAM J. Sci. Comput. 40 (2018), A1494-A1522.
+ *
+ * Usage
+ * ^^^^^
+ *      aaa(data,v,[opts])
+ * or   aaa(data_x,data_y,v,[opts])
+ *
+ * Parameters
+ * ^^^^^^^^^^
+ *      - data      : list of points [[x1,y1],[x2,y2],...,[xn,yn]]
+ *      - v         : identifier, number or list of numbers
+ *      - data_x    : list of x coordinates [x1,x2,...,xn] (distinct reals)
+ *      - data_y    : list of y coordinates [y1,y2,...,yn] (reals)
+ *      - opts      : sequence of options
+ *
+ * Supported options are 'epsilon=<real>', which sets the relative tolerance
+ * (by default 1e-13), and 'degree=<nonnegative integer>', which bounds the
+ * degree of the numerator and denominator (by default 100).
+ *
+ * If v is an identifier, the return value is an expression R(v) in
+ * barycentric form, where R is the rational approximation. Otherwise, R is
+ * evaluated at v, which is faster than substituting into R(v). The maximal
+ * absolute error at the data points is printed out.
+ *
+ * Examples
+ * ^^^^^^^^
+ * X:=[seq(-1.5+3*k/1000,k=0..1000)]:;Y:=tan(X):;
+ * aaa(X,Y,x)
+ * aaa(X,Y,[0.1,0.7,1.45])
+ *    >> [0.100334672085,0.842288380463,8.23809275297]
+ * aaa(X,Y+0.001*randvector(1001,normald,0,1),x,epsilon=1e-3,degree=8)
+ */
+gen _aaa(const gen &g,GIAC_CONTEXT) {
+    if (g.type==_STRNG && g.subtype==-1) return g;
+    if (g.type!=_VECT || g.subtype!=_SEQ__VECT)
+        return gentypeerr(contextptr);
+    vecteur &gv=*g._VECTptr;
+    if (gv.size()<2)
+        return gensizeerr(contextptr);
+    if (gv[0].type!=_VECT)
+        return gentypeerr(contextptr);
+    vecteur xv,yv;
+    int ai=parse_xydata(gv,xv,yv);
+    if (ai<0 || ai>=int(gv.size()))
+        return gensizeerr(contextptr);
+    gen x=gv[ai];
+    double tol=1e-13;
+    int maxdeg=100;
+    for (const_iterateur it=gv.begin()+ai+1;it!=gv.end();++it) {
+        if (!it->is_symb_of_sommet(at_equal))
+            return gensizeerr(contextptr);
+        gen &opt=it->_SYMBptr->feuille._VECTptr->front();
+        gen v=_evalf(it->_SYMBptr->feuille._VECTptr->back(),contextptr);
+        if (is_option(opt,"epsilon",contextptr)) {
+            if (v.type!=_DOUBLE_ || !is_strictly_positive(v,contextptr))
+                return gensizeerr(contextptr);
+            tol=v.DOUBLE_val();
+        } else if (is_option(opt,"degree",contextptr)) {
+            const gen &d=it->_SYMBptr->feuille._VECTptr->back();
+            if (d.type!=_INT_ || (maxdeg=d.val)<0)
+                return gensizeerr(contextptr);
+        } else return gensizeerr(contextptr);
+    }
+    vector<double> zv,fv,sz,sf,w;
+    if (!vecteur2doubles(xv,zv,contextptr) || !vecteur2doubles(yv,fv,contextptr))
+        return gensizeerr(contextptr);
+    vector<double> sorted(zv);
+    std::sort(sorted.begin(),sorted.end());
+    if (std::adjacent_find(sorted.begin(),sorted.end())!=sorted.end()) {
+        *logptr(contextptr) << "Error: the abscissas must be distinct" << endl;
+        return gensizeerr(contextptr);
+    }
+    double err=aaa(zv,fv,tol,maxdeg,sz,sf,w);
+    *logptr(contextptr) << "max. absolute error: " << err << endl;
+    int m=sz.size();
+    if (x.type==_IDNT) {
+        gen num(0),den(0),c;
+        for (int k=0;k<m;++k) {
+            c=gen(w[k])/(x-gen(sz[k]));
+            num+=c*gen(sf[k]);
+            den+=c;
+        }
+        return num/den;
+    }
+    vecteur q(x.type==_VECT?*x._VECTptr:vecteur(1,x)),val(q.size());
+    vector<double> dq,dval;
+    if (!vecteur2doubles(q,dq,contextptr))
+        return gensizeerr(contextptr);
+    aaa_eval(sz,sf,w,dq,dval);
+    for (int i=0;i<int(dval.size());++i) {
+        val[i]=gen(dval[i]);
+    }
+    return x.type==_VECT?gen(val):val.front();
+}
+static const char _aaa_s []="aaa";
+static define_unary_function_eval (__aaa,&_aaa,_aaa_s);
+define_unary_function_ptr5(at_aaa,alias_at_aaa,&__aaa,0,true)
+
 void add_identifiers(const gen &source,vecteur &dest,GIAC_CONTEXT) {
     vecteur v(*_lname(source,contextptr)._VECTptr);
     for (const_iterateur it=v.begin();it!=v.end();++it) {
         if (!contains(dest,*it))
             dest.push_back(*it);
     }
-    dest=*_sort(dest,contextptr)._VECTptr;
+    dest=*_sort(dest,contextptr)._VECTptr;
+}
+
+int indexof(const gen &g,const vecteur &v) {
+    int n=v.size();
+    for (int i=0;i<n;++i) {
+        if (v.at(i)==g)
+            return i;
+    }
+    return -1;
+}
+
+/*
+ * CPROG CLASS IMPLEMENTATION
+ */
+
+int cprog::push(int op,int a,int b,double c) {
+    instr ins;
+    ins.op=op;
+    ins.a=a;
+    ins.b=b;
+    ins.c=c;
+    code.push_back(ins);
+    return code.size()-1;
+}
+
+int cprog::compile(const gen &e,const vecteur &vars,map<const void*,int> &done,vector<int> &vi,GIAC_CONTEXT) {
+    if (e.type==_IDNT) {
+        int i=indexof(e,vars);
+        if (i>=0)
+            return vi[i]<0?(vi[i]=push(_CP_VAR,i)):vi[i];
+    }
+    if (e.type!=_SYMB) {
+        gen ev=_evalf(e,contextptr);
+        return ev.type==_DOUBLE_?push(_CP_CONST,-1,-1,ev.DOUBLE_val()):-1;
+    }
+    map<const void*,int>::const_iterator jt=done.find(e._SYMBptr);
+    if (jt!=done.end())
+        return jt->second;
+    const unary_function_ptr &s=e._SYMBptr->sommet;
+    const gen &f=e._SYMBptr->feuille;
+    int res=-1,a,b;
+    if (s==at_plus || s==at_prod) {
+        if (f.type!=_VECT)
+            res=compile(f,vars,done,vi,contextptr);
+        else {
+            for (const_iterateur it=f._VECTptr->begin();it!=f._VECTptr->end();++it) {
+                if ((a=compile(*it,vars,done,vi,contextptr))<0)
+                    return -1;
+                res=res<0?a:push(s==at_plus?_CP_ADD:_CP_MUL,res,a);
+            }
+        }
+    } else if (s==at_pow) {
+        if (f.type!=_VECT || f._VECTptr->size()!=2)
+            return -1;
+        const gen &ex=f._VECTptr->back();
+        if ((a=compile(f._VECTptr->front(),vars,done,vi,contextptr))<0)
+            return -1;
+        if (ex.is_integer())
+            res=push(_CP_POWI,a,-1,ex.val);
+        else if (ex==fraction(1,2))
+            res=push(_CP_SQRT,a);
+        else if ((b=compile(ex,vars,done,vi,contextptr))>=0)
+            res=push(_CP_POW,a,b);
+    } else {
+        int op;
+        if (s==at_neg) op=_CP_NEG;
+        else if (s==at_inv) op=_CP_INV;
+        else if (s==at_sqrt) op=_CP_SQRT;
+        else if (s==at_exp) op=_CP_EXP;
+        else if (s==at_ln) op=_CP_LN;
+        else if (s==at_sin) op=_CP_SIN;
+        else if (s==at_cos) op=_CP_COS;
+        else if (s==at_tan) op=_CP_TAN;
+        else if (s==at_asin) op=_CP_ASIN;
+        else if (s==at_acos) op=_CP_ACOS;
+        else if (s==at_atan) op=_CP_ATAN;
+        else if (s==at_sinh) op=_CP_SINH;
+        else if (s==at_cosh) op=_CP_COSH;
+        else if (s==at_tanh) op=_CP_TANH;
+        else if (s==at_abs) op=_CP_ABS;
+        else {
+            // an unsupported function, which is acceptable only if e is constant
+            gen ev=_evalf(e,contextptr);
+            return ev.type==_DOUBLE_?push(_CP_CONST,-1,-1,ev.DOUBLE_val()):-1;
+        }
+        if ((a=compile(f,vars,done,vi,contextptr))>=0)
+            res=push(op,a);
+    }
+    if (res>=0)
+        done[e._SYMBptr]=res;
+    return res;
+}
+
+cprog::cprog(const vecteur &exprs,const vecteur &vars,GIAC_CONTEXT) {
+    map<const void*,int> done;
+    vector<int> vi(vars.size(),-1);
+    ok=true;
+    out.resize(exprs.size());
+    for (int i=0;i<int(exprs.size());++i) {
+        if ((out[i]=compile(exprs[i],vars,done,vi,contextptr))<0) {
+            ok=false;
+            break;
+        }
+    }
+}
+
+void cprog::eval(const double *x,double *res,vector<double> &work) const {
+    int len=code.size();
+    if (int(work.size())<len)
+        work.resize(len);
+    double *w=len>0?&work.front():NULL;
+    for (int i=0;i<len;++i) {
+        const instr &ins=code[i];
+        switch (ins.op) {
+        case _CP_CONST: w[i]=ins.c; break;
+        case _CP_VAR: w[i]=x[ins.a]; break;
+        case _CP_ADD: w[i]=w[ins.a]+w[ins.b]; break;
+        case _CP_MUL: w[i]=w[ins.a]*w[ins.b]; break;
+        case _CP_NEG: w[i]=-w[ins.a]; break;
+        case _CP_INV: w[i]=1.0/w[ins.a]; break;
+        case _CP_POWI: {
+            int k=(int)ins.c;
+            double p=1.0,t=w[ins.a];
+            for (int j=k<0?-k:k;j>0;j>>=1,t*=t) {
+                if (j & 1) p*=t;
+            }
+            w[i]=k<0?1.0/p:p;
+            break;
+        }
+        case _CP_POW: w[i]=std::pow(w[ins.a],w[ins.b]); break;
+        case _CP_SQRT: w[i]=std::sqrt(w[ins.a]); break;
+        case _CP_EXP: w[i]=std::exp(w[ins.a]); break;
+        case _CP_LN: w[i]=std::log(w[ins.a]); break;
+        case _CP_SIN: w[i]=std::sin(w[ins.a]); break;
+        case _CP_COS: w[i]=std::cos(w[ins.a]); break;
+        case _CP_TAN: w[i]=std::tan(w[ins.a]); break;
+        case _CP_ASIN: w[i]=std::asin(w[ins.a]); break;
+        case _CP_ACOS: w[i]=std::acos(w[ins.a]); break;
+        case _CP_ATAN: w[i]=std::atan(w[ins.a]); break;
+        case _CP_SINH: w[i]=std::sinh(w[ins.a]); break;
+        case _CP_COSH: w[i]=std::cosh(w[ins.a]); break;
+        case _CP_TANH: w[i]=std::tanh(w[ins.a]); break;
+        case _CP_ABS: w[i]=std::abs(w[ins.a]); break;
+        }
+    }
+    for (int k=0;k<int(out.size());++k) {
+        res[k]=w[out[k]];
+    }
+}
+
+/*
+ * SPARSE_LDLT CLASS IMPLEMENTATION
+ */
+
+sparse_ldlt::sparse_ldlt(int sz,const vector<int> &stage,const vector<pair<int,int> > &pattern) {
+    n=sz;
+    vector<vector<int> > cols(n);
+    for (int j=0;j<n;++j) cols[j].push_back(j);
+    for (vector<pair<int,int> >::const_iterator it=pattern.begin();it!=pattern.end();++it) {
+        cols[it->second].push_back(it->first);
+        if (it->first!=it->second)
+            cols[it->first].push_back(it->second);
+    }
+    colptr.resize(n+1);
+    colptr[0]=0;
+    for (int j=0;j<n;++j) {
+        std::sort(cols[j].begin(),cols[j].end());
+        cols[j].erase(std::unique(cols[j].begin(),cols[j].end()),cols[j].end());
+        rowind.insert(rowind.end(),cols[j].begin(),cols[j].end());
+        colptr[j+1]=rowind.size();
+    }
+    min_degree(stage);
+    symbolic();
+}
+
+int sparse_ldlt::index(int i,int j) const {
+    vector<int>::const_iterator it=std::lower_bound(rowind.begin()+colptr[j],rowind.begin()+colptr[j+1],i);
+    return it!=rowind.begin()+colptr[j+1] && *it==i?it-rowind.begin():-1;
+}
+
+/*
+ * Compute a fill-reducing ordering by the minimum degree algorithm, working
+ * explicitly on the elimination graph. The nodes with stage 0 are eliminated
+ * first and the nodes with stage 2 are not eliminated before at least one of
+ * their neighbors.
+ */
+void sparse_ldlt::min_degree(const vector<int> &stage) {
+    vector<set<int> > adj(n);
+    vector<bool> ready(n);
+    set<pair<pair<int,int>,int> > q;
+    for (int j=0;j<n;++j) {
+        for (int p=colptr[j];p<colptr[j+1];++p) {
+            if (rowind[p]!=j) adj[j].insert(rowind[p]);
+        }
+        if ((ready[j]=(stage[j]<2 || adj[j].empty())))
+            q.insert(make_pair(make_pair(stage[j]>0,(int)adj[j].size()),j));
+    }
+    perm.clear();
+    while (!q.empty()) {
+        int v=q.begin()->second;
+        q.erase(q.begin());
+        perm.push_back(v);
+        vector<int> nb(adj[v].begin(),adj[v].end());
+        for (vector<int>::const_iterator it=nb.begin();it!=nb.end();++it) {
+            if (ready[*it]) q.erase(make_pair(make_pair(stage[*it]>0,(int)adj[*it].size()),*it));
+            adj[*it].erase(v);
+        }
+        for (vector<int>::const_iterator it=nb.begin();it!=nb.end();++it) {
+            for (vector<int>::const_iterator jt=nb.begin();jt!=nb.end();++jt) {
+                if (*it!=*jt) adj[*it].insert(*jt);
+            }
+        }
+        for (vector<int>::const_iterator it=nb.begin();it!=nb.end();++it) {
+            ready[*it]=true;
+            q.insert(make_pair(make_pair(stage[*it]>0,(int)adj[*it].size()),*it));
+        }
+        adj[v].clear();
+    }
+    for (int j=0;j<n;++j) {
+        if (!ready[j]) perm.push_back(j);
+    }
+    pinv.resize(n);
+    for (int k=0;k<n;++k) pinv[perm[k]]=k;
+}
+
+/*
+ * Compute the elimination tree and the column counts of L.
+ *
+ * Source: T. A. Davis, Algorithm 849: A concise sparse Cholesky factorization
+ *         package, ACM Trans. Math. Softw. 31 (2005), 587-591.
+ */
+void sparse_ldlt::symbolic() {
+    vector<int> flag(n),lnz(n,0);
+    parent.resize(n);
+    for (int k=0;k<n;++k) {
+        parent[k]=-1;
+        flag[k]=k;
+        int kk=perm[k];
+        for (int p=colptr[kk];p<colptr[kk+1];++p) {
+            int i=pinv[rowind[p]];
+            if (i<k) for (;flag[i]!=k;i=parent[i]) {
+                if (parent[i]==-1) parent[i]=k;
+                ++lnz[i];
+                flag[i]=k;
+            }
+        }
+    }
+    lcolptr.resize(n+1);
+    lcolptr[0]=0;
+    for (int k=0;k<n;++k) lcolptr[k+1]=lcolptr[k]+lnz[k];
+}
+
+bool sparse_ldlt::factorize(const vector<double> &val,vector<double> &Lx,vector<int> &Li,vector<double> &D,int &neg) const {
+    vector<double> Y(n,0.0);
+    vector<int> pattern(n),flag(n),lnz(n,0);
+    Lx.resize(lcolptr[n]);
+    Li.resize(lcolptr[n]);
+    D.resize(n);
+    neg=0;
+    for (int k=0;k<n;++k) {
+        int top=n,kk=perm[k],len,i,p;
+        flag[k]=k;
+        for (p=colptr[kk];p<colptr[kk+1];++p) {
+            if ((i=pinv[rowind[p]])>k)
+                continue;
+            Y[i]+=val[p];
+            for (len=0;flag[i]!=k;i=parent[i]) {
+                pattern[len++]=i;
+                flag[i]=k;
+            }
+            while (len>0) pattern[--top]=pattern[--len];
+        }
+        double scale=std::abs(D[k]=Y[k]);
+        Y[k]=0;
+        for (;top<n;++top) {
+            i=pattern[top];
+            double yi=Y[i],lki;
+            Y[i]=0;
+            int p2=lcolptr[i]+lnz[i];
+            for (p=lcolptr[i];p<p2;++p) Y[Li[p]]-=Lx[p]*yi;
+            lki=yi/D[i];
+            D[k]-=lki*yi;
+            scale+=std::abs(lki*yi);
+            Li[p]=k;
+            Lx[p]=lki;
+            ++lnz[i];
+        }
+        // the pivot is considered zero if it is at the level of the cancellation error
+        if (!std::isfinite(D[k]) || std::abs(D[k])<=1e-14*scale)
+            return false;
+        if (D[k]<0) ++neg;
+    }
+    return true;
+}
+
+void sparse_ldlt::solve(const vector<double> &Lx,const vector<int> &Li,const vector<double> &D,vector<double> &b) const {
+    vector<double> x(n);
+    for (int k=0;k<n;++k) x[k]=b[perm[k]];
+    for (int j=0;j<n;++j) {
+        for (int p=lcolptr[j];p<lcolptr[j+1];++p) x[Li[p]]-=Lx[p]*x[j];
+    }
+    for (int j=0;j<n;++j) x[j]/=D[j];
+    for (int j=n;j-->0;) {
+        for (int p=lcolptr[j];p<lcolptr[j+1];++p) x[j]-=Lx[p]*x[Li[p]];
+    }
+    for (int k=0;k<n;++k) b[perm[k]]=x[k];
+}
+
+/*
+ * NLPROB CLASS IMPLEMENTATION
+ */
+
+nlprob::nlprob(const gen &f,const vecteur &eq,const vecteur &ineq,const vecteur &vars,const vecteur &params,bool fd,GIAC_CONTEXT) {
+    n=vars.size();
+    meq=eq.size();
+    m=meq+ineq.size();
+    np=params.size();
+    fdhess=fd;
+    lb.resize(n,-HUGE_VAL);
+    ub.resize(n,HUGE_VAL);
+    vecteur allvars=mergevecteur(vars,params);
+    vecteur fcv(1,f),d,d2;
+    fcv=mergevecteur(fcv,mergevecteur(eq,ineq));
+    // detect the variables in each expression, which determine the sparsity pattern
+    vector<vector<int> > ev(m+1);
+    int nterms=0;
+    for (int i=0;i<=m;++i) {
+        vecteur lv=*_lname(fcv[i],contextptr)._VECTptr;
+        for (const_iterateur it=lv.begin();it!=lv.end();++it) {
+            int j=indexof(*it,vars);
+            if (j>=0) ev[i].push_back(j);
+        }
+        std::sort(ev[i].begin(),ev[i].end());
+        nterms+=(ev[i].size()*(ev[i].size()+1))/2;
+    }
+    if (nterms>NLP_MAX_HESSIAN_TERMS)
+        fdhess=true;
+    map<pair<int,int>,int> hmap;
+    for (int i=0;i<=m;++i) {
+        for (vector<int>::const_iterator jt=ev[i].begin();jt!=ev[i].end();++jt) {
+            int j=*jt;
+            gen gj=_derive(makesequence(fcv[i],vars[j]),contextptr);
+            if (is_zero(gj))
+                continue;
+            jrow.push_back(i-1);
+            jcol.push_back(j);
+            d.push_back(gj);
+            vecteur lv=*_lname(gj,contextptr)._VECTptr;
+            for (const_iterateur it=lv.begin();it!=lv.end();++it) {
+                int k=indexof(*it,vars);
+                if (k<0 || k>j)
+                    continue;
+                gen h;
+                if (!fdhess && is_zero(h=_derive(makesequence(gj,vars[k]),contextptr)))
+                    continue;
+                pair<int,int> pos(j,k);
+                map<pair<int,int>,int>::const_iterator mt=hmap.find(pos);
+                int idx;
+                if (mt==hmap.end()) {
+                    idx=hmap[pos]=hrow.size();
+                    hrow.push_back(j);
+                    hcol.push_back(k);
+                } else idx=mt->second;
+                if (!fdhess) {
+                    hown.push_back(i-1);
+                    hpos.push_back(idx);
+                    d2.push_back(h);
+                }
+            }
+        }
+    }
+    fc=cprog(fcv,allvars,contextptr);
+    dfc=cprog(d,allvars,contextptr);
+    if (!fdhess && !(d2fc=cprog(d2,allvars,contextptr)).is_valid())
+        fdhess=true;
+    hadj.resize(n);
+    for (int k=0;k<int(hrow.size());++k) {
+        hadj[hcol[k]].push_back(make_pair(hrow[k],k));
+        if (hrow[k]!=hcol[k])
+            hadj[hrow[k]].push_back(make_pair(hcol[k],k));
+    }
+    if (fdhess)
+        color_hessian();
+    // build the pattern of the augmented KKT matrix
+    //     [ W   J_E^T  J_I^T ]
+    //     [ J_E  -D_E    0   ]
+    //     [ J_I   0    -D_I  ]
+    vector<pair<int,int> > pattern;
+    for (int k=0;k<int(hrow.size());++k) pattern.push_back(make_pair(hrow[k],hcol[k]));
+    for (int k=0;k<int(jrow.size());++k) {
+        if (jrow[k]>=0) pattern.push_back(make_pair(n+jrow[k],jcol[k]));
+    }
+    // the inequality rows are eliminated first, which condenses them into the Hessian block,
+    // and each equality row is eliminated after at least one of its variables
+    vector<int> stage(n+m,1);
+    for (int i=0;i<m;++i) stage[n+i]=i<meq?2:0;
+    kkt=sparse_ldlt(n+m,stage,pattern);
+    kdiag.resize(n+m);
+    for (int i=0;i<n+m;++i) kdiag[i]=kkt.index(i,i);
+    for (int k=0;k<int(hrow.size());++k) {
+        khess.push_back(kkt.index(hrow[k],hcol[k]));
+        khess.push_back(hrow[k]==hcol[k]?-1:kkt.index(hcol[k],hrow[k]));
+    }
+    for (int k=0;k<int(jrow.size());++k) {
+        kjac.push_back(jrow[k]<0?-1:kkt.index(n+jrow[k],jcol[k]));
+        kjac.push_back(jrow[k]<0?-1:kkt.index(jcol[k],n+jrow[k]));
+    }
+}
+
+/*
+ * Partition the columns of the Hessian into groups such that no two columns
+ * in a group have a nonzero in the same row, using the greedy algorithm with
+ * the largest-first ordering. The columns in a group can be estimated by
+ * finite differences from a single gradient evaluation.
+ *
+ * Source: T. F. Coleman and J. J. Moré, Estimation of sparse Hessian
+ *         matrices and graph coloring problems, Math. Program. 28 (1984),
+ *         243-270.
+ */
+void nlprob::color_hessian() {
+    vector<pair<int,int> > ord(n);
+    vector<int> color(n,-1),mark;
+    for (int j=0;j<n;++j) ord[j]=make_pair(-int(hadj[j].size()),j);
+    std::sort(ord.begin(),ord.end());
+    hcolors.clear();
+    for (int l=0;l<n;++l) {
+        int j=ord[l].second,c;
+        mark.assign(hcolors.size()+1,0);
+        // rows of column j, including the diagonal
+        vector<int> rows(1,j);
+        for (int p=0;p<int(hadj[j].size());++p) rows.push_back(hadj[j][p].first);
+        for (vector<int>::const_iterator it=rows.begin();it!=rows.end();++it) {
+            if (color[*it]>=0) mark[color[*it]]=1;
+            for (int p=0;p<int(hadj[*it].size());++p) {
+                int k=hadj[*it][p].first;
+                if (color[k]>=0) mark[color[k]]=1;
+            }
+        }
+        for (c=0;mark[c];++c);
+        if (c==int(hcolors.size()))
+            hcolors.push_back(vector<int>(0));
+        hcolors[c].push_back(j);
+        color[j]=c;
+    }
+}
+
+double nlprob::objective(const vector<double> &x,const double *par) const {
+    vector<double> xp(x.begin(),x.begin()+n),res(m+1),work;
+    if (np>0) xp.insert(xp.end(),par,par+np);
+    fc.eval(&xp.front(),&res.front(),work);
+    return res.front();
+}
+
+double nlprob::violation(const vector<double> &x,const double *par) const {
+    vector<double> xp(x.begin(),x.begin()+n),res(m+1),work;
+    if (np>0) xp.insert(xp.end(),par,par+np);
+    fc.eval(&xp.front(),&res.front(),work);
+    double v=0;
+    for (int i=0;i<m;++i) {
+        v=std::max(v,i<meq?std::abs(res[i+1]):-res[i+1]);
+    }
+    for (int j=0;j<n;++j) {
+        v=std::max(v,std::max(lb[j]-x[j],x[j]-ub[j]));
+    }
+    return v;
+}
+
+/* evaluate the scaled objective and constraints at x, return false if a value is not finite */
+bool nlprob::eval_fc(const double *x,double sf,const vector<double> &sc,vector<double> &res,vector<double> &work) const {
+    res.resize(m+1);
+    fc.eval(x,&res.front(),work);
+    res[0]*=sf;
+    for (int i=0;i<m;++i) res[i+1]*=sc[i];
+    for (int i=0;i<=m;++i) {
+        if (!std::isfinite(res[i]))
+            return false;
+    }
+    return true;
+}
+
+/* evaluate the scaled gradient of f and the entries of the scaled Jacobian of c at x */
+bool nlprob::eval_jacobian(const double *x,double sf,const vector<double> &sc,vector<double> &g,vector<double> &J,vector<double> &work) const {
+    J.resize(dfc.size()+1);
+    dfc.eval(x,&J.front(),work);
+    g.assign(n,0.0);
+    for (int k=0;k<dfc.size();++k) {
+        if (!std::isfinite(J[k]))
+            return false;
+        if (jrow[k]<0)
+            g[jcol[k]]=sf*J[k];
+        else J[k]*=sc[jrow[k]];
+    }
+    return true;
+}
+
+/* evaluate the gradient of sf*f-sum(lambda[i]*sc[i]*c[i]) at x */
+bool nlprob::eval_lagrangian_gradient(const double *x,double sf,const vector<double> &sc,const vector<double> &lambda,
+                                      vector<double> &gl,vector<double> &work) const {
+    vector<double> val(dfc.size()+1);
+    dfc.eval(x,&val.front(),work);
+    gl.assign(n,0.0);
+    for (int k=0;k<dfc.size();++k) {
+        if (!std::isfinite(val[k]))
+            return false;
+        gl[jcol[k]]+=(jrow[k]<0?sf:-lambda[jrow[k]]*sc[jrow[k]])*val[k];
+    }
+    return true;
+}
+
+/* evaluate the entries of the lower triangle of the Hessian of sf*f-sum(lambda[i]*sc[i]*c[i]) at x */
+bool nlprob::eval_hessian(const double *x,double sf,const vector<double> &sc,const vector<double> &lambda,
+                          vector<double> &W,vector<double> &work) const {
+    W.assign(hrow.size(),0.0);
+    if (!fdhess) {
+        vector<double> val(d2fc.size()+1);
+        d2fc.eval(x,&val.front(),work);
+        for (int k=0;k<d2fc.size();++k) {
+            if (!std::isfinite(val[k]))
+                return false;
+            W[hpos[k]]+=(hown[k]<0?sf:-lambda[hown[k]]*sc[hown[k]])*val[k];
+        }
+        return true;
+    }
+    // forward differences of the gradient of the Lagrangian, one evaluation per column group
+    vector<double> gl0,gl,xh(x,x+n+np),h(n);
+    if (!eval_lagrangian_gradient(x,sf,sc,lambda,gl0,work))
+        return false;
+    for (vector<vector<int> >::const_iterator it=hcolors.begin();it!=hcolors.end();++it) {
+        for (vector<int>::const_iterator jt=it->begin();jt!=it->end();++jt) {
+            h[*jt]=1e-7*std::max(1.0,std::abs(x[*jt]));
+            xh[*jt]=x[*jt]+h[*jt];
+            h[*jt]=xh[*jt]-x[*jt];
+        }
+        if (!eval_lagrangian_gradient(&xh.front(),sf,sc,lambda,gl,work))
+            return false;
+        for (vector<int>::const_iterator jt=it->begin();jt!=it->end();++jt) {
+            int j=*jt;
+            xh[j]=x[j];
+            for (vector<pair<int,int> >::const_iterator kt=hadj[j].begin();kt!=hadj[j].end();++kt) {
+                if (kt->first>=j)
+                    W[kt->second]=(gl[kt->first]-gl0[kt->first])/h[j];
+            }
+        }
+    }
+    return true;
+}
+
+/* return the sum of logarithms of the distances of x to the finite bounds */
+double nlprob::bound_barrier(const double *x,const vector<bool> &hl,const vector<bool> &hu) const {
+    double res=0;
+    for (int j=0;j<n;++j) {
+        if (hl[j]) res+=std::log(x[j]-lb[j]);
+        if (hu[j]) res+=std::log(ub[j]-x[j]);
+    }
+    return res;
+}
+
+void nlprob::set_bounds(const vector<double> &lo,const vector<double> &hi) {
+    lb=lo;
+    ub=hi;
+}
+
+/*
+ * Solve the problem with a primal-dual interior point method. Inequalities
+ * are converted to equalities by introducing slack variables s>=0, while the
+ * variable bounds are handled directly by the logarithmic barrier, adding the
+ * diagonal matrix S=Z_L*(X-L)^(-1)+Z_U*(U-X)^(-1) to W. The
+ * barrier subproblems are solved inexactly by Newton steps on the perturbed
+ * KKT conditions. After eliminating the slack steps, the augmented system
+ *
+ *      [W+S+dw*I  J_E^T     J_I^T      ] [ dx]
+ *      [  J_E    -dc*I        0        ] [-dy] = rhs
+ *      [  J_I      0     -S*Z^(-1)-dc*I] [-dz]
+ *
+ * is factorized by the sparse LDL' method. The regularization dw is increased
+ * until the inertia of the matrix is (n,m,0), which guarantees a descent
+ * direction, and dc>0 is used only if the matrix is singular. The step length
+ * is obtained by applying the fraction-to-boundary rule and backtracking on
+ * the l1 exact penalty merit function, with one second-order correction of
+ * the trial step. An infeasible starting point is handled in the same run,
+ * i.e. no separate phase-I problem is solved. The barrier parameter is
+ * decreased by the Fiacco-McCormick rule.
+ *
+ * Source: A. Wächter and L. T. Biegler, On the implementation of an
+ *         interior-point filter line-search algorithm for large-scale
+ *         nonlinear programming, Math. Program. 106 (2006), 25-57.
+ *         J. Nocedal and S. J. Wright, Numerical Optimization, 2nd ed.,
+ *         Springer, 2006 (chapter 19).
+ */
+int nlprob::solve(vector<double> &x,vector<double> &y,double tol,int maxiter,bool warm,const double *par,nlp_stats *stats) const {
+    opt_timer timer("nlprob::solve");
+    int mi=m-meq,N=n+m,nj=jrow.size(),nh=hrow.size(),iter,i,j,k,neg,status=_IPM_ITERATION_LIMIT;
+    int nfev=1,ngev=1,nhev=0;
+    vector<double> work,fcv,fct,g,J,W,sc(m,1.0),s(mi),z(mi),lambda(m),rd(n),Jdx(m);
+    vector<double> dx(n),ds(mi),dz(mi),xk(n+np),st(mi),r(N),rc(N),kv(kkt.nnz()),Lx,D;
+    vector<double> zl(n,0.0),zu(n,0.0),dzl(n,0.0),dzu(n,0.0);
+    vector<int> Li;
+    vector<bool> hl(n),hu(n);
+    double sf=1.0,mu,nu=1.0,dw,dw_last=0,dc,tau,t;
+    int nb=0;
+    // the parameter values are stored after the variables
+    std::copy(x.begin(),x.begin()+n,xk.begin());
+    if (np>0) std::copy(par,par+np,xk.begin()+n);
+    // move the initial point strictly inside the bounds
+    for (j=0;j<n;++j) {
+        nb+=(hl[j]=lb[j]>-HUGE_VAL)+(hu[j]=ub[j]<HUGE_VAL);
+        double pl=1e-2*std::max(1.0,std::abs(lb[j])),pu=1e-2*std::max(1.0,std::abs(ub[j]));
+        if (hl[j] && hu[j]) {
+            pl=std::min(pl,1e-2*(ub[j]-lb[j]));
+            pu=std::min(pu,1e-2*(ub[j]-lb[j]));
+        }
+        if (hl[j]) xk[j]=std::max(xk[j],lb[j]+pl);
+        if (hu[j]) xk[j]=std::min(xk[j],ub[j]-pu);
+    }
+    vector<double> xt(xk);
+    if (!eval_fc(&xk.front(),sf,sc,fcv,work) || !eval_jacobian(&xk.front(),sf,sc,g,J,work))
+        return _IPM_EVALUATION_ERROR;
+    // scale the problem such that all gradients are not larger than 100 at x
+    for (j=0,t=0;j<n;++j) t=std::max(t,std::abs(g[j]));
+    if (t>100) sf=100/t;
+    vector<double> rmax(m,0.0);
+    for (k=0;k<nj;++k) {
+        if (jrow[k]>=0) rmax[jrow[k]]=std::max(rmax[jrow[k]],std::abs(J[k]));
+    }
+    for (i=0;i<m;++i) {
+        if (rmax[i]>100) sc[i]=100/rmax[i];
+    }
+    eval_fc(&xk.front(),sf,sc,fcv,work);
+    eval_jacobian(&xk.front(),sf,sc,g,J,work);
+    ++nfev;
+    ++ngev;
+    // initialize the slacks, the multipliers and the barrier parameter
+    mu=warm?1e-4:0.1;
+    for (i=0;i<mi;++i) s[i]=std::max(fcv[1+meq+i],mu);
+    warm=warm && int(y.size())==m+2*n;
+    for (i=0;i<m;++i) {
+        lambda[i]=warm?y[i]*sf/sc[i]:0.0;
+        if (i>=meq) lambda[i]=std::max(lambda[i],mu/s[i-meq]);
+    }
+    for (i=0;i<mi;++i) z[i]=lambda[meq+i];
+    for (j=0;j<n;++j) {
+        if (hl[j]) zl[j]=std::max(warm?y[m+j]*sf:0.0,mu/(xk[j]-lb[j]));
+        if (hu[j]) zu[j]=std::max(warm?y[m+n+j]*sf:0.0,mu/(ub[j]-xk[j]));
+    }
+    for (iter=0;iter<maxiter;++iter) {
+        ++nhev;
+        if (!eval_hessian(&xk.front(),sf,sc,lambda,W,work)) {
+            status=_IPM_EVALUATION_ERROR;
+            break;
+        }
+        // compute the optimality error
+        double dinf=0,pinf=0,cinf0=0,cinf,sd=0;
+        rd=g;
+        for (k=0;k<nj;++k) {
+            if (jrow[k]>=0) rd[jcol[k]]-=J[k]*lambda[jrow[k]];
+        }
+        for (j=0;j<n;++j) {
+            dinf=std::max(dinf,std::abs(rd[j]-zl[j]+zu[j]));
+            sd+=zl[j]+zu[j];
+            if (hl[j]) cinf0=std::max(cinf0,(xk[j]-lb[j])*zl[j]);
+            if (hu[j]) cinf0=std::max(cinf0,(ub[j]-xk[j])*zu[j]);
+        }
+        for (i=0;i<m;++i) {
+            pinf=std::max(pinf,std::abs(fcv[i+1]-(i<meq?0:s[i-meq])));
+            sd+=std::abs(lambda[i]);
+        }
+        sd=m+nb>0?std::max(100.0,sd/(m+nb))/100:1.0;
+        for (i=0;i<mi;++i) cinf0=std::max(cinf0,s[i]*z[i]);
+        if (stats!=NULL) {
+            stats->pinf.push_back(pinf);
+            stats->dinf.push_back(dinf/sd);
+        }
+        if (std::max(dinf/sd,std::max(pinf,cinf0/sd))<=tol) {
+            status=_IPM_CONVERGED;
+            break;
+        }
+        while (mu>tol/10) {
+            for (i=0,cinf=0;i<mi;++i) cinf=std::max(cinf,std::abs(s[i]*z[i]-mu));
+            for (j=0;j<n;++j) {
+                if (hl[j]) cinf=std::max(cinf,std::abs((xk[j]-lb[j])*zl[j]-mu));
+                if (hu[j]) cinf=std::max(cinf,std::abs((ub[j]-xk[j])*zu[j]-mu));
+            }
+            if (std::max(dinf/sd,std::max(pinf,cinf/sd))>10*mu)
+                break;
+            mu=std::max(tol/10,std::min(0.2*mu,std::pow(mu,1.5)));
+        }
+        // factorize the KKT matrix, regularizing it until its inertia is correct
+        dw=dc=0;
+        while (true) {
+            std::fill(kv.begin(),kv.end(),0.0);
+            for (k=0;k<nh;++k) {
+                kv[khess[2*k]]+=W[k];
+                if (khess[2*k+1]>=0) kv[khess[2*k+1]]+=W[k];
+            }
+            for (k=0;k<nj;++k) {
+                if (jrow[k]>=0) kv[kjac[2*k]]=kv[kjac[2*k+1]]=J[k];
+            }
+            for (j=0;j<n;++j) {
+                kv[kdiag[j]]+=dw;
+                if (hl[j]) kv[kdiag[j]]+=zl[j]/(xk[j]-lb[j]);
+                if (hu[j]) kv[kdiag[j]]+=zu[j]/(ub[j]-xk[j]);
+            }
+            for (i=0;i<m;++i) kv[kdiag[n+i]]=-dc-(i<meq?0:s[i-meq]/z[i-meq]);
+            bool nonsing=kkt.factorize(kv,Lx,Li,D,neg);
+            if (nonsing && neg==m)
+                break;
+            if (!nonsing && meq>0 && dc==0)
+                dc=1e-8*std::pow(mu,0.25);
+            else dw=dw==0?(dw_last==0?1e-4:std::max(1e-20,dw_last/3)):dw*(dw_last==0?100:8);
+            if (dw>1e40)
+                break;
+        }
+        if (dw>1e40) {
+            status=_IPM_SINGULAR_SYSTEM;
+            break;
+        }
+        if (dw>0)
+            dw_last=dw;
+        // compute the step
+        for (j=0;j<n;++j) {
+            r[j]=-rd[j];
+            if (hl[j]) r[j]+=mu/(xk[j]-lb[j]);
+            if (hu[j]) r[j]-=mu/(ub[j]-xk[j]);
+        }
+        for (i=0;i<meq;++i) r[n+i]=-fcv[i+1];
+        for (i=0;i<mi;++i) r[n+meq+i]=mu/z[i]-fcv[1+meq+i];
+        kkt.solve(Lx,Li,D,r);
+        for (j=0;j<n;++j) dx[j]=r[j];
+        std::fill(Jdx.begin(),Jdx.end(),0.0);
+        for (k=0;k<nj;++k) {
+            if (jrow[k]>=0) Jdx[jrow[k]]+=J[k]*dx[jcol[k]];
+        }
+        double curv=0;
+        for (k=0;k<nh;++k) curv+=(hrow[k]==hcol[k]?1:2)*W[k]*dx[hrow[k]]*dx[hcol[k]];
+        for (i=0;i<mi;++i) {
+            ds[i]=Jdx[meq+i]+fcv[1+meq+i]-s[i];
+            dz[i]=mu/s[i]-z[i]-z[i]/s[i]*ds[i];
+            curv+=z[i]/s[i]*Jdx[meq+i]*Jdx[meq+i];
+        }
+        for (j=0;j<n;++j) {
+            if (hl[j]) {
+                dzl[j]=(mu-zl[j]*dx[j])/(xk[j]-lb[j])-zl[j];
+                curv+=zl[j]/(xk[j]-lb[j])*dx[j]*dx[j];
+            }
+            if (hu[j]) {
+                dzu[j]=(mu+zu[j]*dx[j])/(ub[j]-xk[j])-zu[j];
+                curv+=zu[j]/(ub[j]-xk[j])*dx[j]*dx[j];
+            }
+        }
+        // fraction-to-boundary rule
+        tau=std::max(0.99,1-mu);
+        double amax=1,adual=1;
+        for (i=0;i<mi;++i) {
+            if (ds[i]<0) amax=std::min(amax,-tau*s[i]/ds[i]);
+            if (dz[i]<0) adual=std::min(adual,-tau*z[i]/dz[i]);
+        }
+        for (j=0;j<n;++j) {
+            if (hl[j] && dx[j]<0) amax=std::min(amax,-tau*(xk[j]-lb[j])/dx[j]);
+            if (hu[j] && dx[j]>0) amax=std::min(amax,tau*(ub[j]-xk[j])/dx[j]);
+            if (hl[j] && dzl[j]<0) adual=std::min(adual,-tau*zl[j]/dzl[j]);
+            if (hu[j] && dzu[j]<0) adual=std::min(adual,-tau*zu[j]/dzu[j]);
+        }
+        // update the penalty parameter and compute the merit function and its directional derivative
+        double theta=0,phi=fcv[0],dphi=0;
+        for (i=0;i<m;++i) theta+=std::abs(fcv[i+1]-(i<meq?0:s[i-meq]));
+        for (j=0;j<n;++j) dphi+=g[j]*dx[j];
+        for (i=0;i<mi;++i) {
+            phi-=mu*std::log(s[i]);
+            dphi-=mu*ds[i]/s[i];
+        }
+        phi-=mu*bound_barrier(&xk.front(),hl,hu);
+        for (j=0;j<n;++j) {
+            if (hl[j]) dphi-=mu*dx[j]/(xk[j]-lb[j]);
+            if (hu[j]) dphi+=mu*dx[j]/(ub[j]-xk[j]);
+        }
+        if (theta>1e-12) {
+            t=(dphi+0.5*std::max(0.0,curv))/(0.9*theta);
+            if (nu<t) nu=t+1;
+        }
+        phi+=nu*theta;
+        dphi-=nu*theta;
+        // allow for the rounding errors in evaluating the merit function
+        double noise=1e-14*(std::abs(phi)+nu*m);
+        // backtracking line search
+        double alpha=amax,phit;
+        bool accepted=false,soc=false;
+        for (int ls=0;ls<60 && !accepted;++ls) {
+            for (j=0;j<n;++j) xt[j]=xk[j]+alpha*dx[j];
+            for (i=0;i<mi;++i) st[i]=s[i]+alpha*ds[i];
+            ++nfev;
+            if (!eval_fc(&xt.front(),sf,sc,fct,work)) {
+                alpha/=2;
+                continue;
+            }
+            double thetat=0;
+            for (i=0,phit=fct[0];i<m;++i) thetat+=std::abs(fct[i+1]-(i<meq?0:st[i-meq]));
+            for (i=0;i<mi;++i) phit-=mu*std::log(st[i]);
+            phit+=nu*thetat-mu*bound_barrier(&xt.front(),hl,hu);
+            if (phit<=phi+1e-4*alpha*dphi+noise) {
+                accepted=true;
+                break;
+            }
+            if (ls==0 && !soc && alpha==1 && thetat>=theta) {
+                // second-order correction of the full step
+                soc=true;
+                for (j=0;j<n;++j) rc[j]=0;
+                for (i=0;i<meq;++i) rc[n+i]=-fct[i+1];
+                for (i=0;i<mi;++i) rc[n+meq+i]=st[i]-fct[1+meq+i];
+                kkt.solve(Lx,Li,D,rc);
+                vector<double> xc(xt),sv(st),Jc(mi,0.0);
+                bool inside=true;
+                for (j=0;j<n && inside;++j) {
+                    xc[j]+=rc[j];
+                    inside=(!hl[j] || xc[j]-lb[j]>=(1-tau)*(xk[j]-lb[j])) && (!hu[j] || ub[j]-xc[j]>=(1-tau)*(ub[j]-xk[j]));
+                }
+                for (k=0;k<nj;++k) {
+                    if (jrow[k]>=meq) Jc[jrow[k]-meq]+=J[k]*rc[jcol[k]];
+                }
+                for (i=0;i<mi && inside;++i) {
+                    inside=(sv[i]+=Jc[i]+fct[1+meq+i]-st[i])>=(1-tau)*s[i];
+                }
+                vector<double> fcc;
+                if (inside)
+                    ++nfev;
+                if (inside && eval_fc(&xc.front(),sf,sc,fcc,work)) {
+                    for (i=0,phit=fcc[0],thetat=0;i<m;++i) thetat+=std::abs(fcc[i+1]-(i<meq?0:sv[i-meq]));
+                    for (i=0;i<mi;++i) phit-=mu*std::log(sv[i]);
+                    phit+=nu*thetat-mu*bound_barrier(&xc.front(),hl,hu);
+                    if (phit<=phi+1e-4*dphi+noise) {
+                        xt=xc;
+                        st=sv;
+                        fct=fcc;
+                        accepted=true;
+                        break;
+                    }
+                }
+            }
+            alpha/=2;
+        }
+        if (!accepted) {
+            status=_IPM_LINE_SEARCH_FAILED;
+            break;
+        }
+        // update the iterate
+        xk=xt;
+        s=st;
+        fcv=fct;
+        for (i=0;i<meq;++i) lambda[i]-=alpha*r[n+i];
+        for (i=0;i<mi;++i) {
+            z[i]+=adual*dz[i];
+            z[i]=std::max(std::min(z[i],1e10*mu/s[i]),1e-10*mu/s[i]);
+            lambda[meq+i]=z[i];
+        }
+        for (j=0;j<n;++j) {
+            if (hl[j]) {
+                zl[j]+=adual*dzl[j];
+                zl[j]=std::max(std::min(zl[j],1e10*mu/(xk[j]-lb[j])),1e-10*mu/(xk[j]-lb[j]));
+            }
+            if (hu[j]) {
+                zu[j]+=adual*dzu[j];
+                zu[j]=std::max(std::min(zu[j],1e10*mu/(ub[j]-xk[j])),1e-10*mu/(ub[j]-xk[j]));
+            }
+        }
+        ++ngev;
+        if (!eval_jacobian(&xk.front(),sf,sc,g,J,work)) {
+            status=_IPM_EVALUATION_ERROR;
+            break;
+        }
+    }
+    if (stats!=NULL) {
+        stats->iterations=iter;
+        stats->nfev=nfev;
+        stats->ngev=ngev;
+        stats->nhev=nhev;
+    }
+    std::copy(xk.begin(),xk.begin()+n,x.begin());
+    y.resize(m+2*n);
+    for (i=0;i<m;++i) y[i]=lambda[i]*sc[i]/sf;
+    for (j=0;j<n;++j) {
+        y[m+j]=zl[j]/sf;
+        y[m+n+j]=zu[j]/sf;
+    }
+    return status;
+}
+
+struct nlp_sweep_chunk {
+    const nlprob *prob;
+    const vector<double> *x0,*pv;
+    double tol;
+    int maxiter,start,end;
+    vector<vector<double> > *sol;
+    vector<int> *status;
+};
+
+/* solve the problems in the chunk, warm-starting from the previous solution if it was successful */
+void *nlp_sweep_worker(void *arg) {
+    nlp_sweep_chunk *c=static_cast<nlp_sweep_chunk*>(arg);
+    vector<double> x(*c->x0),y;
+    bool warm=false;
+    for (int k=c->start;k<c->end;++k) {
+        int st=c->prob->solve(x,y,c->tol,c->maxiter,warm,&c->pv->at(k));
+        c->status->at(k)=st;
+        c->sol->at(k)=x;
+        if (!(warm=(st==nlprob::_IPM_CONVERGED)))
+            x=*c->x0;
+    }
+    return NULL;
+}
+
+void nlprob::sweep(const vector<double> &x0,const vector<double> &pv,double tol,int maxiter,int nthreads,
+                   vector<vector<double> > &sol,vector<int> &status) const {
+    int len=pv.size();
+    nthreads=std::max(1,std::min(nthreads,len));
+    sol.resize(len);
+    status.resize(len);
+    vector<nlp_sweep_chunk> chunks(nthreads);
+    for (int i=0;i<nthreads;++i) {
+        nlp_sweep_chunk &c=chunks[i];
+        c.prob=this;
+        c.x0=&x0;
+        c.pv=&pv;
+        c.tol=tol;
+        c.maxiter=maxiter;
+        c.start=(i*len)/nthreads;
+        c.end=((i+1)*len)/nthreads;
+        c.sol=&sol;
+        c.status=&status;
+    }
+#ifdef HAVE_LIBPTHREAD
+    vector<pthread_t> threads(nthreads);
+    vector<bool> started(nthreads,false);
+    for (int i=1;i<nthreads;++i) {
+        started[i]=pthread_create(&threads[i],NULL,nlp_sweep_worker,&chunks[i])==0;
+    }
+    nlp_sweep_worker(&chunks[0]);
+    for (int i=1;i<nthreads;++i) {
+        if (started[i])
+            pthread_join(threads[i],NULL);
+        else nlp_sweep_worker(&chunks[i]);
+    }
+#else
+    for (int i=0;i<nthreads;++i) {
+        nlp_sweep_worker(&chunks[i]);
+    }
+#endif
+}
+
+struct nlp_multistart_data {
+    const nlprob *prob;
+    const vector<vector<double> > *xs;
+    const vector<double> *w;
+    double r,tol;
+    int maxiter,next,front;
+    vector<int> state; // 0: not finished, 1: converged, 2: failed, 3: skipped
+    vector<vector<double> > res,*sol;
+#ifdef HAVE_LIBPTHREAD
+    pthread_mutex_t mutex;
+#endif
+};
+
+/* return true iff the distance between x and some point in pts is smaller than r */
+bool nlp_is_near(const vector<double> &x,const vector<vector<double> > &pts,const vector<double> &w,double r) {
+    for (vector<vector<double> >::const_iterator it=pts.begin();it!=pts.end();++it) {
+        double d=0;
+        for (int j=0;j<int(x.size());++j) d=std::max(d,std::abs(x[j]-it->at(j))/w[j]);
+        if (d<r)
+            return true;
+    }
+    return false;
+}
+
+/* accept the finished solves in the order of the start points, a solution is discarded if its start
+ * point would have been skipped in a sequential run (the mutex must be locked) */
+void nlp_multistart_advance(nlp_multistart_data *d) {
+    for (;d->front<d->next && d->state[d->front]!=0;++d->front) {
+        int k=d->front;
+        if (d->state[k]==1 && !nlp_is_near(d->xs->at(k),*d->sol,*d->w,d->r) && !nlp_is_near(d->res[k],*d->sol,*d->w,1e-6))
+            d->sol->push_back(d->res[k]);
+    }
+}
+
+/* take start points one by one and run a local solve from each of them, the start points near the
+ * already accepted solutions are skipped */
+void *nlp_multistart_worker(void *arg) {
+    nlp_multistart_data *d=static_cast<nlp_multistart_data*>(arg);
+    vector<double> x,y;
+    int len=d->xs->size(),k;
+    while (true) {
+#ifdef HAVE_LIBPTHREAD
+        pthread_mutex_lock(&d->mutex);
+#endif
+        bool done=d->next>=len,skip=false;
+        if (!done && (skip=nlp_is_near(d->xs->at(k=d->next++),*d->sol,*d->w,d->r))) {
+            d->state[k]=3;
+            nlp_multistart_advance(d);
+        }
+#ifdef HAVE_LIBPTHREAD
+        pthread_mutex_unlock(&d->mutex);
+#endif
+        if (done)
+            break;
+        if (skip)
+            continue;
+        x=d->xs->at(k);
+        bool conv=d->prob->solve(x,y,d->tol,d->maxiter)==nlprob::_IPM_CONVERGED;
+#ifdef HAVE_LIBPTHREAD
+        pthread_mutex_lock(&d->mutex);
+#endif
+        d->res[k]=x;
+        d->state[k]=conv?1:2;
+        nlp_multistart_advance(d);
+#ifdef HAVE_LIBPTHREAD
+        pthread_mutex_unlock(&d->mutex);
+#endif
+    }
+    return NULL;
+}
+
+void nlprob::multistart(const vector<vector<double> > &xs,const vector<double> &w,double r,double tol,
+                        int maxiter,int nthreads,vector<vector<double> > &sol) const {
+    nlp_multistart_data d;
+    d.prob=this;
+    d.xs=&xs;
+    d.w=&w;
+    d.r=r;
+    d.tol=tol;
+    d.maxiter=maxiter;
+    d.next=d.front=0;
+    d.state.assign(xs.size(),0);
+    d.res.resize(xs.size());
+    d.sol=&sol;
+    sol.clear();
+#ifdef HAVE_LIBPTHREAD
+    pthread_mutex_init(&d.mutex,NULL);
+    vector<pthread_t> threads(std::max(0,nthreads-1));
+    vector<bool> started(threads.size(),false);
+    for (int i=0;i<int(threads.size());++i) {
+        started[i]=pthread_create(&threads[i],NULL,nlp_multistart_worker,&d)==0;
+    }
+    nlp_multistart_worker(&d);
+    for (int i=0;i<int(threads.size());++i) {
+        if (started[i])
+            pthread_join(threads[i],NULL);
+    }
+    pthread_mutex_destroy(&d.mutex);
+#else
+    nlp_multistart_worker(&d);
+#endif
+}
+
+void nlprob::start_points(const vector<double> &x0,int count,vector<vector<double> > &xs,vector<double> &w,GIAC_CONTEXT) const {
+    vector<double> a(n);
+    vector<vector<double> > pts(count,vector<double>(n));
+    w.resize(n);
+    // get the sampling box, unbounded variables are sampled around the initial point
+    for (int j=0;j<n;++j) {
+        bool fa=lb[j]>-HUGE_VAL,fb=ub[j]<HUGE_VAL;
+        a[j]=fa?lb[j]:(fb?ub[j]-10:x0[j]-5);
+        w[j]=fb && ub[j]>a[j]?ub[j]-a[j]:(fb?1.0:10.0);
+    }
+    // generate the points by Latin hypercube sampling
+    vector<int> perm(count);
+    for (int j=0;j<n;++j) {
+        for (int k=0;k<count;++k) perm[k]=k;
+        for (int k=count-1;k>0;--k) std::swap(perm[k],perm[giac_rand(contextptr)%(k+1)]);
+        for (int k=0;k<count;++k) {
+            pts[k][j]=a[j]+w[j]*(perm[k]+giac_rand(contextptr)/(rand_max2+1.0))/count;
+        }
+    }
+    // start from the most promising points: feasible points with smaller objective values first
+    vector<pair<pair<double,double>,int> > ord(count);
+    for (int k=0;k<count;++k) {
+        ord[k]=make_pair(make_pair(violation(pts[k]),objective(pts[k])),k);
+        if (!std::isfinite(ord[k].first.second))
+            ord[k].first.first=HUGE_VAL;
+    }
+    std::sort(ord.begin(),ord.end());
+    xs.assign(1,x0);
+    for (int k=0;k<count;++k) {
+        xs.push_back(pts[ord[k].second]);
+    }
+}
+
+/*
+ * Return the total degree of the polynomial e in vars, or -1 if e is not
+ * a polynomial in vars.
+ */
+int nlp_degree(const gen &e,const vecteur &vars,GIAC_CONTEXT) {
+    vecteur lv=*_lname(e,contextptr)._VECTptr;
+    bool cst=true;
+    for (const_iterateur it=lv.begin();cst && it!=lv.end();++it) {
+        cst=!contains(vars,*it);
+    }
+    if (cst)
+        return 0;
+    if (e.type==_IDNT)
+        return 1;
+    if (e.type!=_SYMB)
+        return -1;
+    const gen &arg=e._SYMBptr->feuille;
+    const unary_function_ptr &u=e._SYMBptr->sommet;
+    if (u==at_neg)
+        return nlp_degree(arg,vars,contextptr);
+    if (u==at_plus || u==at_prod) {
+        vecteur args=arg.type==_VECT?*arg._VECTptr:vecteur(1,arg);
+        int d=0,k;
+        for (const_iterateur it=args.begin();it!=args.end();++it) {
+            if ((k=nlp_degree(*it,vars,contextptr))<0)
+                return -1;
+            d=u==at_plus?std::max(d,k):d+k;
+        }
+        return d;
+    }
+    if (u==at_pow && arg.type==_VECT && arg._VECTptr->size()==2) {
+        const gen &ex=arg._VECTptr->back();
+        int d=nlp_degree(arg._VECTptr->front(),vars,contextptr);
+        if (d<0 || !ex.is_integer() || ex.val<0)
+            return -1;
+        return d*ex.val;
+    }
+    return -1;
+}
+
+/*
+ * QPROG CLASS IMPLEMENTATION
+ */
+
+qprog::qprog(const gen &f,const vecteur &eq,const vecteur &ineq,const vecteur &vars,GIAC_CONTEXT) {
+    n=vars.size();
+    meq=eq.size();
+    m=meq+ineq.size();
+    vecteur g=mergevecteur(eq,ineq),zero(n,0);
+    int d=nlp_degree(f,vars,contextptr);
+    ok=d>=0 && d<=2;
+    linear=d<=1;
+    for (const_iterateur it=g.begin();ok && it!=g.end();++it) {
+        d=nlp_degree(*it,vars,contextptr);
+        ok=d>=0 && d<=1;
+    }
+    lb.resize(n,-HUGE_VAL);
+    ub.resize(n,HUGE_VAL);
+    if (!ok)
+        return;
+    H.resize(n*n,0.0);
+    c.resize(n);
+    A.resize(m*n);
+    b.resize(m);
+    gen e;
+    for (int j=0;ok && j<n;++j) {
+        gen dj=_derive(makesequence(f,vars[j]),contextptr);
+        ok=(e=_evalf(subst(dj,vars,zero,false,contextptr),contextptr)).type==_DOUBLE_;
+        if (ok) c[j]=e.DOUBLE_val();
+        for (int k=0;ok && k<n && !linear;++k) {
+            ok=(e=_evalf(_derive(makesequence(dj,vars[k]),contextptr),contextptr)).type==_DOUBLE_;
+            if (ok) H[j*n+k]=e.DOUBLE_val();
+        }
+    }
+    for (int i=0;ok && i<m;++i) {
+        ok=(e=_evalf(subst(g[i],vars,zero,false,contextptr),contextptr)).type==_DOUBLE_;
+        if (ok) b[i]=-e.DOUBLE_val();
+        for (int j=0;ok && j<n;++j) {
+            ok=(e=_evalf(_derive(makesequence(g[i],vars[j]),contextptr),contextptr)).type==_DOUBLE_;
+            if (ok) A[i*n+j]=e.DOUBLE_val();
+        }
+    }
+}
+
+void qprog::set_bounds(const vector<double> &lo,const vector<double> &hi) {
+    lb=lo;
+    ub=hi;
+}
+
+/* return the right-hand side of the bound constraint i>=m, or -HUGE_VAL if the bound is absent */
+double qprog::bound_value(int i) const {
+    int j=(i-m)%n;
+    if (i<m+n)
+        return lb[j];
+    return ub[j]<HUGE_VAL?-ub[j]:-HUGE_VAL;
+}
+
+int qprog::solve(vector<double> &x,int maxiter,int &iter) const {
+    opt_timer timer("qprog::solve");
+    iter=0;
+    return linear?simplex(x,maxiter,iter):dual_active_set(x,maxiter,iter);
+}
+
+/*
+ * Pivot the dense simplex tableau T with rows of width W on the entry (p,q).
+ */
+void simplex_pivot(vector<double> &T,int rows,int W,int p,int q,vector<int> &nz) {
+    double *rp=&T[p*W],piv=rp[q];
+    nz.clear();
+    for (int k=0;k<W;++k) {
+        if (rp[k]!=0) {
+            rp[k]/=piv;
+            nz.push_back(k);
+        }
+    }
+    for (int i=0;i<rows;++i) {
+        double *ri=&T[i*W],l=ri[q];
+        if (i!=p && l!=0) for (vector<int>::const_iterator it=nz.begin();it!=nz.end();++it) ri[*it]-=l*rp[*it];
+    }
+}
+
+/*
+ * Solve the linear program by the two-phase bounded simplex method on the
+ * dense tableau. The variables with a lower bound are shifted to it, those
+ * with only an upper bound are reflected and the free variables are split to
+ * positive and negative parts. Upper bounds on the shifted variables are
+ * handled by the upper-bounding technique, i.e. a nonbasic variable is either
+ * at zero or at its upper bound. The inequalities get surplus variables,
+ * which form the initial basis where possible; the other rows start with
+ * artificial variables, which are not stored. Dantzig's rule is used for
+ * choosing the entering variable, switching to Bland's rule after a number of
+ * degenerate pivots to prevent cycling.
+ */
+int qprog::simplex(vector<double> &x,int maxiter,int &iter) const {
+    int mi=m-meq,nc=2*n+mi,W=nc+1,i,j,nart=0;
+    vector<double> T((m+1)*W,0.0),cap(nc,HUGE_VAL),shift(n,0.0);
+    vector<int> basis(m),nz;
+    vector<bool> allowed(nc,true),atub(nc,false);
+    for (j=0;j<n;++j) {
+        if (lb[j]>-HUGE_VAL) {
+            shift[j]=lb[j];
+            cap[j]=ub[j]-lb[j];
+            allowed[n+j]=false;
+        } else if (ub[j]<HUGE_VAL) {
+            shift[j]=ub[j];
+            allowed[j]=false;
+        }
+        if (cap[j]<0)
+            return _QP_INFEASIBLE;
+    }
+    double scale=1;
+    for (i=0;i<m;++i) {
+        double *row=&T[i*W],bi=b[i];
+        for (j=0;j<n;++j) bi-=A[i*n+j]*shift[j];
+        double sg=(i<meq?bi<0:bi<=0)?-1:1;
+        for (j=0;j<n;++j) {
+            row[j]=sg*A[i*n+j];
+            row[n+j]=-row[j];
+        }
+        if (i>=meq) row[2*n+i-meq]=-sg;
+        row[nc]=sg*bi;
+        // the basic variable is either the surplus or an artificial variable (with index >= nc)
+        basis[i]=i>=meq && sg<0?2*n+i-meq:nc+(nart++);
+        scale=std::max(scale,row[nc]);
+    }
+    double *obj=&T[m*W],tol=1e-9;
+    // phase I: minimize the sum of artificial variables
+    for (i=0;i<m;++i) {
+        if (basis[i]<nc)
+            continue;
+        for (j=0;j<=nc;++j) obj[j]-=T[i*W+j];
+    }
+    for (int phase=nart>0?1:2;phase<=2;++phase) {
+        if (phase==2) {
+            // set up the reduced costs of the original objective
+            std::fill(obj,obj+W,0.0);
+            for (j=0;j<n;++j) {
+                obj[j]=c[j];
+                obj[n+j]=-c[j];
+            }
+            for (j=0;j<nc;++j) {
+                if (atub[j]) obj[nc]-=obj[j]*cap[j];
+            }
+            for (i=0;i<m;++i) {
+                double cb=basis[i]<2*n?obj[basis[i]]:0.0;
+                if (cb!=0) for (j=0;j<W;++j) obj[j]-=cb*T[i*W+j];
+            }
+        }
+        int degenerate=0;
+        while (true) {
+            if (++iter>maxiter)
+                return _QP_ITERATION_LIMIT;
+            // choose the entering variable, which is decreased if it is at its upper bound
+            bool bland=degenerate>50;
+            int p=-1,q=-1;
+            double dq=0;
+            for (j=0;j<nc;++j) {
+                double d=atub[j]?-obj[j]:obj[j];
+                if (allowed[j] && d<-tol && (q<0 || (!bland && d<dq))) {
+                    q=j;
+                    dq=d;
+                    if (bland) break;
+                }
+            }
+            if (q<0)
+                break;
+            // ratio test, the entering variable may also reach its own bound
+            double sg=atub[q]?-1:1,theta=cap[q],t;
+            bool toub=false;
+            for (i=0;i<m;++i) {
+                double a=sg*T[i*W+q];
+                int bv=basis[i];
+                if (a>tol)
+                    t=T[i*W+nc]/a;
+                else if (a<-tol && bv<nc && cap[bv]<HUGE_VAL)
+                    t=(cap[bv]-T[i*W+nc])/(-a);
+                else continue;
+                if (t<theta || (p>=0 && t==theta && bv<basis[p])) {
+                    theta=t;
+                    p=i;
+                    toub=a<0;
+                }
+            }
+            if (theta==HUGE_VAL)
+                return phase==1?_QP_INFEASIBLE:_QP_UNBOUNDED;
+            degenerate=theta<=tol?degenerate+1:0;
+            for (i=0;i<=m;++i) T[i*W+nc]-=sg*T[i*W+q]*theta;
+            if (p<0) {
+                // bound flip without pivoting
+                atub[q]=!atub[q];
+                continue;
+            }
+            double val=atub[q]?cap[q]-theta:theta;
+            if (basis[p]<nc) atub[basis[p]]=toub;
+            atub[q]=false;
+            T[p*W+nc]=0;
+            simplex_pivot(T,m+1,W,p,q,nz);
+            T[p*W+nc]=val;
+            basis[p]=q;
+        }
+        if (phase==1) {
+            if (-obj[nc]>1e-8*scale)
+                return _QP_INFEASIBLE;
+            // drive the artificial variables out of the basis, the rows where that is impossible are redundant
+            for (i=0;i<m;++i) {
+                if (basis[i]<nc)
+                    continue;
+                for (j=0;j<nc && (!allowed[j] || std::abs(T[i*W+j])<=tol);++j);
+                if (j<nc) {
+                    double val=atub[j]?cap[j]:0.0;
+                    T[i*W+nc]=0;
+                    simplex_pivot(T,m+1,W,i,j,nz);
+                    T[i*W+nc]=val;
+                    atub[j]=false;
+                    basis[i]=j;
+                }
+            }
+        }
+    }
+    vector<double> v(nc,0.0);
+    for (j=0;j<nc;++j) {
+        if (atub[j]) v[j]=cap[j];
+    }
+    for (i=0;i<m;++i) {
+        if (basis[i]<nc) v[basis[i]]=T[i*W+nc];
+    }
+    x.resize(n);
+    for (j=0;j<n;++j) {
+        if (lb[j]>-HUGE_VAL)
+            x[j]=lb[j]+v[j];
+        else if (ub[j]<HUGE_VAL)
+            x[j]=ub[j]-v[n+j];
+        else x[j]=v[j]-v[n+j];
+    }
+    return _QP_OPTIMAL;
+}
+
+/*
+ * Solve the strictly convex quadratic program by the dual active set method.
+ * The method starts from the unconstrained minimum and adds the violated
+ * constraints one at a time while keeping the dual feasibility, dropping the
+ * constraints whose multipliers would become negative. The matrices J and R
+ * satisfying J'*N=[R;0] for the matrix N of active constraint normals are
+ * updated by Givens rotations, with J=L^(-T) initially, where H=L*L'.
+ *
+ * Source: D. Goldfarb and A. Idnani, A numerically stable dual method for
+ *         solving strictly convex quadratic programs, Math. Program. 27
+ *         (1983), 1-33.
+ */
+int qprog::dual_active_set(vector<double> &x,int maxiter,int &iter) const {
+    int i,j,k,q=0;
+    vector<double> L(H),J(n*n,0.0),R(n*n,0.0),d(n),z(n),r(n),u,up,np(n);
+    vector<int> act;
+    // Cholesky factorization H=L*L'
+    for (j=0;j<n;++j) {
+        double s=L[j*n+j];
+        for (k=0;k<j;++k) s-=L[j*n+k]*L[j*n+k];
+        if (s<=1e-14*std::max(1.0,std::abs(H[j*n+j])))
+            return _QP_NOT_CONVEX;
+        L[j*n+j]=std::sqrt(s);
+        for (i=j+1;i<n;++i) {
+            double t=L[i*n+j];
+            for (k=0;k<j;++k) t-=L[i*n+k]*L[j*n+k];
+            L[i*n+j]=t/L[j*n+j];
+        }
+    }
+    // J=L^(-T) is upper triangular
+    for (j=0;j<n;++j) {
+        for (i=j;i>=0;--i) {
+            double t=i==j?1.0:0.0;
+            for (k=i+1;k<=j;++k) t-=L[k*n+i]*J[k*n+j];
+            J[i*n+j]=t/L[i*n+i];
+        }
+    }
+    // the unconstrained minimum x=-J*J'*c
+    x.assign(n,0.0);
+    for (k=0;k<n;++k) {
+        double t=0;
+        for (i=0;i<n;++i) t+=J[i*n+k]*c[i];
+        for (i=0;i<n;++i) x[i]-=J[i*n+k]*t;
+    }
+    // the bounds are handled as the constraints x_j>=lb_j and -x_j>=-ub_j with indices m+j and m+n+j
+    vector<bool> active(m+2*n,false);
+    while (true) {
+        // choose the most violated constraint, equalities first
+        int p=-1;
+        double sp=0,sg=1;
+        for (i=0;i<m+2*n;++i) {
+            if (active[i] || (i>=m && bound_value(i)==-HUGE_VAL))
+                continue;
+            double s,nrm;
+            if (i<m) {
+                s=-b[i];
+                nrm=std::abs(b[i]);
+                for (j=0;j<n;++j) {
+                    s+=A[i*n+j]*x[j];
+                    nrm+=std::abs(A[i*n+j]*x[j]);
+                }
+            } else {
+                j=(i-m)%n;
+                s=(i<m+n?x[j]:-x[j])-bound_value(i);
+                nrm=std::abs(x[j]);
+            }
+            if (i<meq)
+                s=-std::abs(s);
+            if (s<-1e-10*std::max(1.0,nrm) && (p<0 || (i<meq && p>=meq) || ((i<meq)==(p<meq) && s<sp))) {
+                p=i;
+                sp=s;
+            }
+        }
+        if (p<0)
+            return _QP_OPTIMAL;
+        if (p<meq) {
+            for (j=0,sg=-b[p];j<n;++j) sg+=A[p*n+j]*x[j];
+            sg=sg>0?-1:1;
+        }
+        double bp=p<m?b[p]:bound_value(p);
+        for (j=0;j<n;++j) np[j]=p<m?sg*A[p*n+j]:0.0;
+        if (p>=m) np[(p-m)%n]=p<m+n?1:-1;
+        up=u;
+        up.push_back(0);
+        while (true) {
+            if (++iter>maxiter)
+                return _QP_ITERATION_LIMIT;
+            // compute the primal and dual step directions z and r
+            for (k=0;k<n;++k) {
+                for (i=0,d[k]=0;i<n;++i) d[k]+=J[i*n+k]*np[i];
+            }
+            double znp=0,t1=HUGE_VAL,t2=HUGE_VAL;
+            for (i=0;i<n;++i) {
+                for (k=q,z[i]=0;k<n;++k) z[i]+=J[i*n+k]*d[k];
+                znp+=z[i]*np[i];
+            }
+            for (k=q;k-->0;) {
+                r[k]=d[k];
+                for (j=k+1;j<q;++j) r[k]-=R[k*n+j]*r[j];
+                r[k]/=R[k*n+k];
+            }
+            int l=-1;
+            for (k=0;k<q;++k) {
+                if (act[k]>=meq && r[k]>0 && up[k]/r[k]<t1) {
+                    t1=up[k]/r[k];
+                    l=k;
+                }
+            }
+            double dnrm=0;
+            for (k=0;k<n;++k) dnrm=std::max(dnrm,std::abs(d[k]));
+            if (znp>1e-14*dnrm*dnrm)
+                t2=-sp/znp;
+            if (t1==HUGE_VAL && t2==HUGE_VAL)
+                return _QP_INFEASIBLE;
+            double t=std::min(t1,t2);
+            if (t2<HUGE_VAL) {
+                for (i=0;i<n;++i) x[i]+=t*z[i];
+            }
+            for (k=0;k<q;++k) up[k]-=t*r[k];
+            up[q]+=t;
+            if (t==t2) {
+                // add the constraint p, rotating d to zero its components below q
+                for (k=n-1;k>q;--k) {
+                    double a=d[k-1],bb=d[k],h=std::sqrt(a*a+bb*bb);
+                    if (h==0)
+                        continue;
+                    double cs=a/h,sn=bb/h;
+                    d[k-1]=h;
+                    d[k]=0;
+                    for (i=0;i<n;++i) {
+                        double ja=J[i*n+k-1],jb=J[i*n+k];
+                        J[i*n+k-1]=cs*ja+sn*jb;
+                        J[i*n+k]=cs*jb-sn*ja;
+                    }
+                }
+                for (k=0;k<=q;++k) R[k*n+q]=d[k];
+                act.push_back(p);
+                active[p]=true;
+                u=up;
+                ++q;
+                break;
+            }
+            // drop the constraint l and restore the triangular form of R
+            active[act[l]]=false;
+            act.erase(act.begin()+l);
+            up.erase(up.begin()+l);
+            for (k=l;k<q-1;++k) {
+                for (i=0;i<=k+1;++i) R[i*n+k]=R[i*n+k+1];
+            }
+            for (i=0;i<q;++i) R[i*n+q-1]=0;
+            for (k=l;k<q-1;++k) {
+                double a=R[k*n+k],bb=R[(k+1)*n+k],h=std::sqrt(a*a+bb*bb);
+                if (h==0)
+                    continue;
+                double cs=a/h,sn=bb/h;
+                for (j=k;j<q-1;++j) {
+                    double ra=R[k*n+j],rb=R[(k+1)*n+j];
+                    R[k*n+j]=cs*ra+sn*rb;
+                    R[(k+1)*n+j]=cs*rb-sn*ra;
+                }
+                for (i=0;i<n;++i) {
+                    double ja=J[i*n+k],jb=J[i*n+k+1];
+                    J[i*n+k]=cs*ja+sn*jb;
+                    J[i*n+k+1]=cs*jb-sn*ja;
+                }
+            }
+            --q;
+            for (j=0,sp=-sg*bp;j<n;++j) sp+=np[j]*x[j];
+        }
+    }
 }
 
-int indexof(const gen &g,const vecteur &v) {
-    int n=v.size();
-    for (int i=0;i<n;++i) {
-        if (v.at(i)==g)
-            return i;
+/*
+ * Split the constraints to equalities eq=0 and inequalities ineq>=0.
+ */
+bool nlp_split_constraints(const vecteur &constr,vecteur &eq,vecteur &ineq,GIAC_CONTEXT) {
+    for (const_iterateur it=constr.begin();it!=constr.end();++it) {
+        if (it->is_symb_of_sommet(at_equal))
+            eq.push_back(_equal2diff(*it,contextptr));
+        else if (it->is_symb_of_sommet(at_inferieur_egal))
+            ineq.push_back(_rhs(*it,contextptr)-_lhs(*it,contextptr));
+        else if (it->is_symb_of_sommet(at_superieur_egal))
+            ineq.push_back(_lhs(*it,contextptr)-_rhs(*it,contextptr));
+        else {
+            *logptr(contextptr) << "Error: unrecognized constraint " << *it << endl;
+            return false;
+        }
     }
-    return -1;
+    return true;
+}
+
+/*
+ * Return the solver statistics st as a table.
+ */
+gen nlp_stats_table(const nlp_stats &st,GIAC_CONTEXT) {
+    gen tab=makemap();
+    gen_map &m=*tab._MAPptr;
+    m[string2gen("method",false)]=string2gen(st.method,false);
+    m[string2gen("termination",false)]=string2gen(st.reason,false);
+    if (st.iterations>=0)
+        m[string2gen("iterations",false)]=st.iterations;
+    if (st.nfev>=0) {
+        m[string2gen("function_evaluations",false)]=st.nfev;
+        m[string2gen("gradient_evaluations",false)]=st.ngev;
+        m[string2gen("hessian_evaluations",false)]=st.nhev;
+    }
+    if (!st.pinf.empty()) {
+        vecteur pinf,dinf;
+        for (int k=0;k<int(st.pinf.size());++k) {
+            pinf.push_back(gen(st.pinf[k]));
+            dinf.push_back(gen(st.dinf[k]));
+        }
+        m[string2gen("violation",false)]=gen(pinf,_LIST__VECT);
+        m[string2gen("dual_infeasibility",false)]=gen(dinf,_LIST__VECT);
+    }
+    m[string2gen("phase1_time",false)]=gen(st.phase1_time);
+    m[string2gen("phase2_time",false)]=gen(st.phase2_time);
+    return tab;
+}
+
+/*
+ * Return the list [optval,sol] for the solution sol, or undef if sol is
+ * undefined, followed by the table of solver statistics if st is given.
+ */
+gen nlp_result(const gen &obj,const vecteur &vars,const gen &sol,const nlp_stats *st,GIAC_CONTEXT) {
+    if (is_undef(sol) && st==NULL)
+        return undef;
+    vecteur res(2,undef);
+    if (!is_undef(sol)) {
+        res[0]=_subs(makesequence(obj,vars,sol),contextptr);
+        res[1]=_zip(makesequence(at_equal,vars,sol),contextptr);
+    }
+    if (st!=NULL)
+        res.push_back(nlp_stats_table(*st,contextptr));
+    return gen(res,_LIST__VECT);
 }
 
 /*
  * 'nlpsolve' computes an optimum of a nonlinear objective function, subject to
- * nonlinear equality and inequality constraints, using the COBYLA algorithm.
+ * nonlinear equality and inequality constraints, using the COBYLA algorithm
+ * or the interior point method (IPM).
  *
  * Syntax
  * ^^^^^^
@@ -2357,11 +5049,74 @@ int indexof(const gen &g,const vecteur &v) {
  *       nlp_initialpoint=[x1=a,x2=b,...]
  *       nlp_precision=real
  *       nlp_iterationlimit=intg
+ *       method=cobyla or method=ipm
+ *       hessian=exact or hessian=fd
+ *       sweep=(p=[p1,p2,...,pk])
+ *       threads=intg
+ *       multistart=intg
+ *       stats[=true]
  *
  * If initial point is not given, it will be automatically generated. The given
  * point does not need to be feasible. Note that choosing a good initial point
  * is needed for obtaining a correct solution in some cases.
  *
+ * If no method is specified, the objective is at most quadratic and the
+ * constraints are linear, the problem is solved numerically by the simplex
+ * method (linear programs) or by the dual active set method of Goldfarb and
+ * Idnani (strictly convex quadratic programs). Other quadratic programs are
+ * solved by IPM.
+ *
+ * By default, COBYLA is used. With method=ipm, the objective, the constraints
+ * and their first and second partial derivatives are compiled to floating-point
+ * code and the problem is solved by a primal-dual interior point method, which
+ * is much faster for smooth problems. An infeasible initial point is handled
+ * within the same run. If the problem contains functions which cannot be
+ * compiled, COBYLA is used instead. Only the structurally nonzero derivatives
+ * are compiled and the KKT system is solved by sparse LDL' factorization, so
+ * problems with many variables and sparse couplings are handled efficiently.
+ * With hessian=fd, the Hessian is approximated by finite differences of the
+ * compiled gradients, grouping the structurally independent columns such that
+ * only a few gradient evaluations are needed. This is also done automatically
+ * when the second derivatives are too many or cannot be compiled. Compiled
+ * problems are cached (see 'optcache'), so solving the same problem again,
+ * e.g. from another initial point or with other bounds, skips compilation.
+ *
+ * The variable bounds given by bd and assume=nlp_nonnegative are handled
+ * directly by the simplex, active set and interior point methods (by bound
+ * flipping, as implicit constraints and by the logarithmic barrier,
+ * respectively) instead of being converted to general constraints. Only
+ * COBYLA receives them as ordinary inequalities.
+ *
+ * With sweep=(p=[p1,p2,...,pk]), the problem depending on a parameter p is
+ * solved for p=p1,p2,...,pk by IPM and the list of k solutions is returned.
+ * The problem is compiled only once, and each solution is used as the initial
+ * point (together with the Lagrange multipliers) for the next value of p,
+ * which is efficient when the solution varies continuously with p. With the
+ * option threads=N, the list of values is split into N contiguous chunks
+ * which are processed in parallel. If the solver fails for some value, the
+ * corresponding solution is undef. Solutions at which the iteration limit was
+ * exceeded are returned, but their number is reported in a warning.
+ *
+ * With multistart=N, N start points are generated by Latin hypercube sampling
+ * inside the variable bounds (unbounded variables are sampled in an interval
+ * of length 10), and local IPM solves are run from them in parallel (the
+ * number of threads is set by the threads option). The points closer to a
+ * local solution found from a preceding start point than half of the typical
+ * sample spacing are skipped, so the result does not depend on the number of
+ * threads. The result is the list [optval,sol,optima], where optval and sol
+ * are the best found value and solution, and optima is the list of distinct
+ * local optima found, ordered from the best to the worst.
+ *
+ * With stats=true, a table of solver statistics is appended to the result
+ * [optval,sol] (or to [undef,undef] if the solver fails). It contains the
+ * method used, the termination reason, the number of iterations, the numbers
+ * of function, gradient and Hessian evaluations, the constraint violation and
+ * the dual infeasibility in each iteration (the last three are available only
+ * for IPM, where the values are scaled as in the convergence test), and the
+ * time in seconds spent in phase I (finding a feasible initial point for
+ * COBYLA) and in phase II (the optimization). Statistics are not collected
+ * for sweeps and multistart searches.
+ *
  * Examples
  * ^^^^^^^^
  * (problems taken from:
@@ -2383,37 +5138,62 @@ int indexof(const gen &g,const vecteur &v) {
  * nlpsolve(x^3+2x*y-2y^2,x=-10..10,y=-10..10,nlp_initialpoint=[x=3,y=4],maximize) // Maple example
  * nlpsolve(w^3*(v-w)^2+(w-x-1)^2+(x-y-2)^2+(y-z-3)^2,[w+x+y+z<=5,3z+2v=3],assume=nlp_nonnegative) // Maple example
  * nlpsolve(sin(x)*Psi(x),x=1..20,nlp_initialpoint=[x=16]) // Maple example, needs an initial point
+ * nlpsolve(-x1*x2*x3,[72-x1-2x2-2x3>=0],x1=0..20,x2=0..11,x3=0..42,method=ipm) // problem 36 using IPM
+ * nlpsolve((x-p)^2+y^2,[x^2+y^2<=1],sweep=(p=seq(k/10,k=0..20)),threads=2) // parameter sweep
+ * nlpsolve(sin(x1+x2)+(x1-x2)^2-1.5x1+2.5x2+1,x1=-1.5..4,x2=-3..3,multistart=20) // problem 5, global minimum
+ * nlpsolve(3x+5y,[x<=4,2y<=12,3x+2y<=18],assume=nlp_nonnegative,maximize) // linear program
+ * nlpsolve((x-1)^2+(y-2.5)^2,[x-2y+2>=0,-x-2y+6>=0,-x+2y+2>=0],assume=nlp_nonnegative) // quadratic program
+ * nlpsolve(ln(1+x1^2)-x2,[(1+x1^2)^2+x2^2=4],method=ipm,stats) // problem 7 with solver statistics
  */
 gen _nlpsolve(const gen &g,GIAC_CONTEXT) {
     if (g.type==_STRNG && g.subtype==-1) return g;
+    opt_timer timer("nlpsolve");
     if (g.type!=_VECT || g.subtype!=_SEQ__VECT || g._VECTptr->size() < 2)
         return gentypeerr(contextptr);
     vecteur &gv=*g._VECTptr;
-    vecteur constr,vars,initp;
+    vecteur constr,vars,initp,svals,lbv,ubv;
     gen &obj=gv.front();
+    gen spar=undef;
     add_identifiers(obj,vars,contextptr);
     const_iterateur it=gv.begin();
-    bool maximize=false;
-    int maxiter=RAND_MAX;
+    bool maximize=false,use_ipm=false,fdhess=false,auto_method=true,nonneg=false,want_stats=false;
+    int maxiter=RAND_MAX,nthreads=1,nstarts=0;
     double eps=epsilon(contextptr);
     if (gv.at(1).type==_VECT) {
         constr=*gv.at(1)._VECTptr;
         add_identifiers(constr,vars,contextptr);
         ++it;
     }
+    // find the sweep parameter, which is not a problem variable
+    for (const_iterateur jt=it+1;jt<gv.end();++jt) {
+        if (jt->is_symb_of_sommet(at_equal) && is_option(_lhs(*jt,contextptr),"sweep",contextptr)) {
+            gen rh=_rhs(*jt,contextptr);
+            if (!rh.is_symb_of_sommet(at_equal) || (spar=_lhs(rh,contextptr)).type!=_IDNT ||
+                    _rhs(rh,contextptr).type!=_VECT || _rhs(rh,contextptr)._VECTptr->empty())
+                return gensizeerr(contextptr);
+            svals=*_rhs(rh,contextptr)._VECTptr;
+            int i=indexof(spar,vars);
+            if (i>=0)
+                vars.erase(vars.begin()+i);
+        }
+    }
     initp=vecteur(vars.size(),gen(1));
+    lbv=vecteur(vars.size(),minus_inf);
+    ubv=vecteur(vars.size(),plus_inf);
     while (++it!=gv.end()) {
         if (*it==at_maximize || (it->is_integer() && it->val==_NLP_MAXIMIZE))
             maximize=true;
+        else if (is_option(*it,"stats",contextptr))
+            want_stats=true;
         else if (it->is_symb_of_sommet(at_equal)) {
             gen &lh=it->_SYMBptr->feuille._VECTptr->front();
             gen &rh=it->_SYMBptr->feuille._VECTptr->back();
-            if (lh==at_assume && rh.is_integer() && rh.val==_NLP_NONNEGATIVE) {
-                for (const_iterateur jt=vars.begin();jt!=vars.end();++jt) {
-                    constr.push_back(symbolic(at_inferieur_egal,makevecteur(gen(0),*jt)));
-                }
-            } else if (lh==at_maximize && rh.is_integer())
+            if (lh==at_assume && rh.is_integer() && rh.val==_NLP_NONNEGATIVE)
+                nonneg=true;
+            else if (lh==at_maximize && rh.is_integer())
                 maximize=(bool)rh.val;
+            else if (is_option(lh,"stats",contextptr) && rh.is_integer())
+                want_stats=(bool)rh.val;
             else if (lh.is_integer() && lh.val==_NLP_INITIALPOINT && rh.type==_VECT) {
                 vecteur &pnt=*rh._VECTptr;
                 for (const_iterateur jt=pnt.begin();jt!=pnt.end();++jt) {
@@ -2428,99 +5208,1010 @@ gen _nlpsolve(const gen &g,GIAC_CONTEXT) {
                 maximize=(bool)rh.val;
             else if(lh.is_integer() && lh.val==_NLP_PRECISION && rh.type==_DOUBLE_)
                 eps=rh.DOUBLE_val();
-            else if (contains(vars,lh) && rh.is_symb_of_sommet(at_interval)) {
+            else if (is_option(lh,"method",contextptr)) {
+                auto_method=false;
+                if (is_option(rh,"ipm",contextptr))
+                    use_ipm=true;
+                else if (is_option(rh,"cobyla",contextptr))
+                    use_ipm=false;
+                else return gensizeerr(contextptr);
+            } else if (is_option(lh,"hessian",contextptr)) {
+                if (is_option(rh,"fd",contextptr))
+                    fdhess=true;
+                else if (is_option(rh,"exact",contextptr))
+                    fdhess=false;
+                else return gensizeerr(contextptr);
+            } else if (is_option(lh,"threads",contextptr)) {
+                if (!rh.is_integer() || (nthreads=rh.val)<1)
+                    return gensizeerr(contextptr);
+            } else if (is_option(lh,"multistart",contextptr)) {
+                if (!rh.is_integer() || (nstarts=rh.val)<1)
+                    return gensizeerr(contextptr);
+            } else if (contains(vars,lh) && rh.is_symb_of_sommet(at_interval)) {
                 gen &lb=rh._SYMBptr->feuille._VECTptr->front();
                 gen &ub=rh._SYMBptr->feuille._VECTptr->back();
-                if (!is_inf(lh))
-                    constr.push_back(symbolic(at_superieur_egal,makevecteur(lh,lb)));
-                if (!is_inf(rh))
-                    constr.push_back(symbolic(at_inferieur_egal,makevecteur(lh,ub)));
+                if (is_zero(lb-ub))
+                    constr.push_back(symbolic(at_equal,makevecteur(lh,lb)));
+                else {
+                    lbv[indexof(lh,vars)]=lb;
+                    ubv[indexof(lh,vars)]=ub;
+                }
+            }
+        }
+    }
+    // the bounds are passed to the numeric solvers directly
+    vector<double> lo(vars.size()),hi(vars.size());
+    for (int j=0;j<int(vars.size());++j) {
+        if (nonneg && (is_inf(lbv[j]) || is_strictly_greater(0,lbv[j],contextptr)))
+            lbv[j]=0;
+        gen a=_evalf(lbv[j],contextptr),b=_evalf(ubv[j],contextptr);
+        if ((!is_inf(a) && a.type!=_DOUBLE_) || (!is_inf(b) && b.type!=_DOUBLE_)) {
+            *logptr(contextptr) << "Error: the variable bounds must be numeric" << endl;
+            return gensizeerr(contextptr);
+        }
+        lo[j]=is_inf(a)?-HUGE_VAL:a.DOUBLE_val();
+        hi[j]=is_inf(b)?HUGE_VAL:b.DOUBLE_val();
+    }
+    gen sol=undef;
+    nlp_stats st,*stp=want_stats?&st:NULL;
+    if (want_stats && (!is_undef(spar) || nstarts>0))
+        *logptr(contextptr) << "Warning: statistics are not collected for sweeps and multistart searches" << endl;
+    if (!is_undef(spar)) {
+        // solve the problem for each value of the parameter
+        vecteur eq,ineq,res;
+        vector<double> x0,pv,f;
+        vector<vector<double> > sols;
+        vector<int> status;
+        if (!nlp_split_constraints(constr,eq,ineq,contextptr))
+            return gentypeerr(contextptr);
+        if (!vecteur2doubles(*_evalf(initp,contextptr)._VECTptr,x0,contextptr) ||
+                !vecteur2doubles(*_evalf(svals,contextptr)._VECTptr,pv,contextptr)) {
+            *logptr(contextptr) << "Error: the initial point and the parameter values must be numeric" << endl;
+            return gensizeerr(contextptr);
+        }
+        nlprob prob(nlp_compile(maximize?-obj:obj,eq,ineq,vars,vecteur(1,spar),fdhess,contextptr));
+        if (!prob.is_valid()) {
+            *logptr(contextptr) << "Error: failed to compile the problem" << endl;
+            return gensizeerr(contextptr);
+        }
+        prob.set_bounds(lo,hi);
+        prob.sweep(x0,pv,std::max(eps,1e-10),maxiter==RAND_MAX?3000:maxiter,nthreads,sols,status);
+        int nfail=0,nlimit=0;
+        for (int k=0;k<int(pv.size());++k) {
+            if (status[k]!=nlprob::_IPM_CONVERGED && status[k]!=nlprob::_IPM_ITERATION_LIMIT) {
+                res.push_back(undef);
+                ++nfail;
+                continue;
+            }
+            if (status[k]==nlprob::_IPM_ITERATION_LIMIT)
+                ++nlimit;
+            vecteur solv(sols[k].size());
+            for (int i=0;i<int(solv.size());++i) {
+                solv[i]=gen(sols[k][i]);
+            }
+            double fv=prob.objective(sols[k],&pv[k]);
+            res.push_back(gen(makevecteur(gen(maximize?-fv:fv),_zip(makesequence(at_equal,vars,solv),contextptr)),_LIST__VECT));
+        }
+        if (nlimit>0)
+            *logptr(contextptr) << "Warning: iteration limit exceeded for " << nlimit << " parameter value(s)" << endl;
+        if (nfail>0)
+            *logptr(contextptr) << "Warning: failed to solve the problem for " << nfail << " parameter value(s)" << endl;
+        return gen(res,_LIST__VECT);
+    }
+    if (nstarts>0) {
+        // multistart global search
+        int n=vars.size();
+        vecteur eq,ineq,optima;
+        vector<double> x0,w;
+        vector<vector<double> > starts,sols;
+        if (!nlp_split_constraints(constr,eq,ineq,contextptr))
+            return gentypeerr(contextptr);
+        if (!vecteur2doubles(*_evalf(initp,contextptr)._VECTptr,x0,contextptr)) {
+            *logptr(contextptr) << "Error: the initial point must be numeric" << endl;
+            return gensizeerr(contextptr);
+        }
+        nlprob prob(nlp_compile(maximize?-obj:obj,eq,ineq,vars,vecteur(0),fdhess,contextptr));
+        if (!prob.is_valid()) {
+            *logptr(contextptr) << "Error: failed to compile the problem" << endl;
+            return gensizeerr(contextptr);
+        }
+        prob.set_bounds(lo,hi);
+        prob.start_points(x0,nstarts,starts,w,contextptr);
+        prob.multistart(starts,w,0.5*std::pow(double(nstarts),-1.0/n),std::max(eps,1e-10),
+                        maxiter==RAND_MAX?3000:maxiter,nthreads,sols);
+        if (sols.empty()) {
+            *logptr(contextptr) << "Error: no local solution was found" << endl;
+            return undef;
+        }
+        vector<pair<double,int> > fv(sols.size());
+        for (int k=0;k<int(sols.size());++k) {
+            fv[k]=make_pair(prob.objective(sols[k]),k);
+        }
+        std::sort(fv.begin(),fv.end());
+        for (int k=0;k<int(fv.size());++k) {
+            vecteur solv(n);
+            for (int j=0;j<n;++j) {
+                solv[j]=gen(sols[fv[k].second][j]);
+            }
+            optima.push_back(gen(makevecteur(gen(maximize?-fv[k].first:fv[k].first),
+                                             _zip(makesequence(at_equal,vars,solv),contextptr)),_LIST__VECT));
+        }
+        *logptr(contextptr) << "Found " << optima.size() << " distinct local optima" << endl;
+        vecteur &best=*optima.front()._VECTptr;
+        return gen(makevecteur(best.front(),best.back(),gen(optima,_LIST__VECT)),_LIST__VECT);
+    }
+    if (auto_method) {
+        // solve linear and quadratic programs by the dedicated methods
+        vecteur eq,ineq;
+        vector<double> x;
+        if (!nlp_split_constraints(constr,eq,ineq,contextptr))
+            return gentypeerr(contextptr);
+        qprog qp(maximize?-obj:obj,eq,ineq,vars,contextptr);
+        qp.set_bounds(lo,hi);
+        if (qp.is_valid()) {
+            double t0=wall_time();
+            int qpst=qp.solve(x,maxiter,st.iterations);
+            st.phase2_time=wall_time()-t0;
+            st.method=qp.is_linear()?"simplex":"active set";
+            switch (qpst) {
+            case qprog::_QP_OPTIMAL: {
+                st.reason="optimal";
+                vecteur solv(x.size());
+                for (int i=0;i<int(x.size());++i) {
+                    solv[i]=gen(x[i]);
+                }
+                sol=solv;
+                break;
+            }
+            case qprog::_QP_INFEASIBLE:
+                *logptr(contextptr) << "Error: the problem is infeasible" << endl;
+                st.reason="infeasible";
+                return nlp_result(obj,vars,undef,stp,contextptr);
+            case qprog::_QP_UNBOUNDED:
+                *logptr(contextptr) << "Error: the problem is unbounded" << endl;
+                st.reason="unbounded";
+                return nlp_result(obj,vars,undef,stp,contextptr);
+            case qprog::_QP_ITERATION_LIMIT:
+                *logptr(contextptr) << "Error: iteration limit exceeded" << endl;
+                st.reason="iteration limit exceeded";
+                return nlp_result(obj,vars,undef,stp,contextptr);
+            case qprog::_QP_NOT_CONVEX:
+                st.iterations=-1;
+                use_ipm=true;
+                break;
+            }
+        }
+    }
+    if (is_undef(sol) && use_ipm) {
+        vecteur eq,ineq;
+        if (!nlp_split_constraints(constr,eq,ineq,contextptr))
+            return gentypeerr(contextptr);
+        nlprob prob(nlp_compile(maximize?-obj:obj,eq,ineq,vars,vecteur(0),fdhess,contextptr));
+        vector<double> x,y;
+        if (!vecteur2doubles(*_evalf(initp,contextptr)._VECTptr,x,contextptr)) {
+            *logptr(contextptr) << "Error: the initial point must be numeric" << endl;
+            return gensizeerr(contextptr);
+        }
+        prob.set_bounds(lo,hi);
+        if (!prob.is_valid())
+            *logptr(contextptr) << "Warning: failed to compile the problem, using COBYLA instead" << endl;
+        else {
+            double t0=wall_time();
+            int ipmst=prob.solve(x,y,std::max(eps,1e-10),maxiter==RAND_MAX?3000:maxiter,false,NULL,stp);
+            st.phase2_time=wall_time()-t0;
+            st.method="ipm";
+            switch (ipmst) {
+            case nlprob::_IPM_CONVERGED:
+                st.reason="converged";
+                break;
+            case nlprob::_IPM_ITERATION_LIMIT:
+                *logptr(contextptr) << "Warning: iteration limit exceeded" << endl;
+                st.reason="iteration limit exceeded";
+                break;
+            case nlprob::_IPM_LINE_SEARCH_FAILED:
+                *logptr(contextptr) << "Error: line search failed, try another initial point" << endl;
+                st.reason="line search failed";
+                return nlp_result(obj,vars,undef,stp,contextptr);
+            case nlprob::_IPM_SINGULAR_SYSTEM:
+                *logptr(contextptr) << "Error: failed to regularize the KKT system" << endl;
+                st.reason="singular KKT system";
+                return nlp_result(obj,vars,undef,stp,contextptr);
+            case nlprob::_IPM_EVALUATION_ERROR:
+                *logptr(contextptr) << "Error: the problem is not defined at some iterate" << endl;
+                st.reason="evaluation error";
+                return nlp_result(obj,vars,undef,stp,contextptr);
+            }
+            vecteur solv(x.size());
+            for (int i=0;i<int(x.size());++i) {
+                solv[i]=gen(x[i]);
+            }
+            sol=solv;
+        }
+    }
+    if (is_undef(sol)) {
+        // COBYLA handles the bounds as general constraints
+        for (int j=0;j<int(vars.size());++j) {
+            if (lo[j]>-HUGE_VAL)
+                constr.push_back(symbolic(at_superieur_egal,makevecteur(vars[j],lbv[j])));
+            if (hi[j]<HUGE_VAL)
+                constr.push_back(symbolic(at_inferieur_egal,makevecteur(vars[j],ubv[j])));
+        }
+        if (constr.empty()) {
+            *logptr(contextptr) << "Error: no contraints detected" << endl;
+            return gensizeerr(contextptr);
+        }
+        bool feasible=true;
+        for (it=constr.begin();it!=constr.end();++it) {
+            if (it->is_symb_of_sommet(at_equal)) {
+                gen expr=_equal2diff(*it,contextptr);
+                if (!is_zero(_subs(makesequence(expr,vars,initp),contextptr))) {
+                    feasible=false;
+                    break;
+                }
+            } else if (it->is_symb_of_sommet(at_inferieur_egal) || it->is_symb_of_sommet(at_superieur_egal)) {
+                if (_evalb(_subs(makesequence(*it,vars,initp),contextptr),contextptr).val==0) {
+                    feasible=false;
+                    break;
+                }
+            } else {
+                *logptr(contextptr) << "Error: unrecognized constraint " << *it << endl;
+                return gentypeerr(contextptr);
+            }
+        }
+        st=nlp_stats();
+        st.method="cobyla";
+        opt_timer ctimer("nlpsolve (cobyla)");
+        try {
+            double t0=wall_time();
+            if (!feasible) {
+                initp=*_fMin(makesequence(gen(0),constr,vars,initp),contextptr)._VECTptr;
+                st.phase1_time=wall_time()-t0;
+                if (is_undef(initp) || initp.empty()) {
+                    *logptr(contextptr) << "Error: unable to generate a feasible initial point" << endl;
+                    st.reason="no feasible point found";
+                    return nlp_result(obj,vars,undef,stp,contextptr);
+                }
+                *logptr(contextptr) << "Using a generated feasible initial point " << initp << endl;
+                t0=wall_time();
+            }
+            gen args=makesequence(obj,constr,vars,initp,gen(eps),gen(maxiter));
+            if (maximize)
+                sol=_fMax(args,contextptr);
+            else
+                sol=_fMin(args,contextptr);
+            st.phase2_time=wall_time()-t0;
+            st.reason=is_undef(sol)?"failed":"converged";
+        } catch (std::runtime_error &err) {
+            *logptr(contextptr) << "Error: " << err.what() << endl;
+            st.reason=err.what();
+            return nlp_result(obj,vars,undef,stp,contextptr);
+        }
+    }
+    return nlp_result(obj,vars,sol,stp,contextptr);
+}
+static const char _nlpsolve_s []="nlpsolve";
+static define_unary_function_eval (__nlpsolve,&_nlpsolve,_nlpsolve_s);
+define_unary_function_ptr5(at_nlpsolve,alias_at_nlpsolve,&__nlpsolve,0,true)
+
+/*
+ * 'optcache' controls the cache of compiled problems which is shared by
+ * 'minimize', 'maximize', 'extrema' and 'nlpsolve'. The cache stores the
+ * critical points obtained from the KKT conditions, the classified critical
+ * points and the compiled problems (with their derivatives and the structure
+ * of the KKT matrix), so that solving the same model again, e.g. from another
+ * initial point or with other bounds, skips the symbolic preprocessing. The
+ * least recently used entries are removed when the cache is full.
+ *
+ * Usage
+ * ^^^^^
+ *      optcache([cap])
+ *
+ * Parameters
+ * ^^^^^^^^^^
+ *   - cap (optional) : the maximal number of entries (default 64), 0 clears
+ *                      the cache and disables it
+ *
+ * The return value is a table containing the numbers of cache hits and
+ * misses, the number of entries and the capacity.
+ *
+ * Examples
+ * ^^^^^^^^
+ * optcache()
+ * optcache(256)
+ * optcache(0)
+ */
+gen _optcache(const gen &g,GIAC_CONTEXT) {
+    if (g.type==_STRNG && g.subtype==-1) return g;
+    optcache &cache=optcache::instance();
+    if (g.type==_VECT && g._VECTptr->empty())
+        return cache.stats();
+    if (!g.is_integer() || g.val<0)
+        return gentypeerr(contextptr);
+    if (g.val==0)
+        cache.clear();
+    cache.set_capacity(g.val);
+    return cache.stats();
+}
+static const char _optcache_s []="optcache";
+static define_unary_function_eval (__optcache,&_optcache,_optcache_s);
+define_unary_function_ptr5(at_optcache,alias_at_optcache,&__optcache,0,true)
+
+/*
+ * 'optprofile' controls the profiling of the optimization commands. When
+ * profiling is enabled, the number of calls and the cumulative time spent in
+ * each of the major phases of 'minimize', 'extrema', 'implicitdiff',
+ * 'tpsolve', 'minimax', 'thiele', 'triginterp', 'kernel_density' and
+ * 'nlpsolve' are recorded. Profiling is disabled by default, in which case
+ * the overhead is negligible.
+ *
+ * Usage
+ * ^^^^^
+ *      optprofile([on])
+ *
+ * Parameters
+ * ^^^^^^^^^^
+ *   - on (optional) : true or 1 resets the counters and enables profiling,
+ *                     false or 0 disables it
+ *
+ * The return value is a table mapping the phase names to the lists
+ * [calls,ns], where ns is the cumulative time in nanoseconds. Nested phases
+ * are included in the time of the enclosing phase.
+ *
+ * Examples
+ * ^^^^^^^^
+ * optprofile(true)
+ * extrema(x^3-3x*y+y^3,[x,y]); optprofile()
+ * optprofile(false)
+ */
+gen _optprofile(const gen &g,GIAC_CONTEXT) {
+    if (g.type==_STRNG && g.subtype==-1) return g;
+    if (g.type==_VECT && g._VECTptr->empty())
+        return opt_timer::table();
+    if (!g.is_integer() || g.val<0 || g.val>1)
+        return gentypeerr(contextptr);
+    opt_timer::enable(g.val==1);
+    return opt_timer::table();
+}
+static const char _optprofile_s []="optprofile";
+static define_unary_function_eval (__optprofile,&_optprofile,_optprofile_s);
+define_unary_function_ptr5(at_optprofile,alias_at_optprofile,&__optprofile,0,true)
+
+/* uniform pseudo-random number in [0,1) from a fixed seed, for reproducible benchmarks */
+double optbench_rand(unsigned long long &seed) {
+    seed=seed*6364136223846793005ULL+1442695040888963407ULL;
+    return double(seed>>11)/9007199254740992.0;
+}
+
+/* random integer in [lo,hi] */
+int optbench_randint(unsigned long long &seed,int lo,int hi) {
+    return lo+std::min(hi-lo,int(optbench_rand(seed)*(hi-lo+1)));
+}
+
+/* escape a string for inclusion in JSON output */
+string optbench_json_string(const string &s) {
+    stringstream ss;
+    ss << "\"";
+    for (string::const_iterator it=s.begin();it!=s.end();++it) {
+        switch (*it) {
+        case '"': ss << "\\\""; break;
+        case '\\': ss << "\\\\"; break;
+        case '\n': ss << "\\n"; break;
+        case '\t': ss << "\\t"; break;
+        default: ss << *it;
+        }
+    }
+    ss << "\"";
+    return ss.str();
+}
+
+typedef gen (*optbench_command)(const gen &,GIAC_CONTEXT);
+
+/*
+ * Generate the arguments of the command 'cmd' for a benchmark problem of
+ * size n (and m constraints, where applicable). Return the command function
+ * or NULL if the command is not supported.
+ */
+optbench_command optbench_problem(const string &cmd,int n,int &m,unsigned long long &seed,gen &args,GIAC_CONTEXT) {
+    vecteur vars(n),constr,data;
+    for (int i=0;i<n;++i) {
+        vars[i]=make_idnt("x",i+1,false);
+    }
+    gen x=identificateur("x"),y=identificateur("y");
+    if (cmd=="minimize" || cmd=="maximize" || cmd=="nlpsolve") {
+        // quadratic objective with m random linear inequality constraints
+        gen obj(0);
+        for (int i=0;i<n;++i) {
+            obj+=pow(vars[i]-gen(i+1),2);
+            if (cmd=="nlpsolve" && i+1<n)
+                obj+=vars[i]*vars[i+1]/gen(2);
+        }
+        for (int i=0;i<m;++i) {
+            gen lhs(0);
+            for (int j=0;j<n;++j) {
+                lhs+=gen(optbench_randint(seed,-5,5))*vars[j];
+            }
+            constr.push_back(symbolic(at_inferieur_egal,makevecteur(lhs,gen(optbench_randint(seed,1,10)))));
+        }
+        if (cmd!="nlpsolve") {
+            args=constr.empty()?makesequence(cmd=="minimize"?obj:-obj,vars):makesequence(cmd=="minimize"?obj:-obj,constr,vars);
+            return cmd=="minimize"?&_minimize:&_maximize;
+        }
+        vecteur argv(1,obj);
+        if (!constr.empty())
+            argv.push_back(constr);
+        for (int i=0;i<n;++i) {
+            argv.push_back(symbolic(at_equal,makevecteur(vars[i],symbolic(at_interval,makesequence(-10,10)))));
+        }
+        args=gen(argv,_SEQ__VECT);
+        return &_nlpsolve;
+    }
+    if (cmd=="extrema") { // 2^n critical points
+        gen f(0);
+        for (int i=0;i<n;++i) {
+            f+=pow(vars[i],3)-3*vars[i];
+        }
+        args=makesequence(f,vars);
+        return &_extrema;
+    }
+    if (cmd=="implicitdiff") { // derivative of order n of a function given implicitly
+        vecteur argv=makevecteur(symbolic(at_equal,makevecteur(-2*pow(x,3)+15*pow(x,2)*y+11*pow(y,3)-24*y,0)),y);
+        for (int i=0;i<n;++i) {
+            argv.push_back(x);
+        }
+        args=gen(argv,_SEQ__VECT);
+        return &_implicitdiff;
+    }
+    if (cmd=="minimax") { // polynomial approximation of degree n
+        args=makesequence(exp(x,contextptr),symbolic(at_equal,makevecteur(x,symbolic(at_interval,makesequence(0,1)))),n);
+        return &_minimax;
+    }
+    if (cmd=="tpsolve") { // m sources, n destinations, balanced
+        if (m<1)
+            m=n;
+        vecteur supply(m),demand(n,0);
+        matrice cost(m);
+        int total=0;
+        for (int i=0;i<m;++i) {
+            supply[i]=optbench_randint(seed,1,99);
+            total+=supply[i].val;
+            vecteur row(n);
+            for (int j=0;j<n;++j) {
+                row[j]=optbench_randint(seed,1,99);
+            }
+            cost[i]=row;
+        }
+        if (total<n) { // raise the last supply so that every demand is positive
+            supply[m-1]+=n-total;
+            total=n;
+        }
+        for (int j=0;j<n;++j) {
+            demand[j]=j+1<n?total/n:total-(n-1)*(total/n);
+        }
+        args=makesequence(supply,demand,cost);
+        return &_tpsolve;
+    }
+    if (cmd=="thiele" || cmd=="triginterp") { // n samples of a smooth function
+        vecteur xv(n);
+        for (int i=0;i<n;++i) {
+            double t=cmd=="thiele"?double(i)/n:2*M_PI*i/n;
+            xv[i]=t;
+            data.push_back(std::exp(std::sin(t))+std::cos(3*t));
+        }
+        if (cmd=="thiele") {
+            args=makesequence(xv,data,x);
+            return &_thiele;
+        }
+        args=makesequence(data,symbolic(at_equal,makevecteur(x,symbolic(at_interval,makesequence(0,2*_IDNT_pi())))));
+        return &_triginterp;
+    }
+    if (cmd=="kernel_density" || cmd=="kde") { // n samples from a bimodal normal mixture
+        data.resize(n);
+        for (int i=0;i<n;++i) {
+            double u=std::max(optbench_rand(seed),1e-300),v=optbench_rand(seed);
+            data[i]=std::sqrt(-2*std::log(u))*std::cos(2*M_PI*v)+(i%3==0?4.0:0.0);
+        }
+        args=data;
+        return &_kernel_density;
+    }
+    return NULL;
+}
+
+/*
+ * 'optbench' runs a command from this module on a family of generated problems
+ * of increasing size and reports the timings in JSON format, so that the
+ * results can be stored and compared to detect performance regressions. The
+ * problems are generated from a fixed seed, hence they are the same in every
+ * session.
+ *
+ * Note that 'optbench' affects the state of the session: the cache of
+ * compiled problems (see 'optcache') is cleared before each run, so that the
+ * timings do not depend on previous computations, and the profiling counters
+ * (see 'optprofile') are reset. Whether profiling is enabled is restored
+ * when 'optbench' returns.
+ *
+ * Usage
+ * ^^^^^
+ *      optbench(cmd,sizes,[reps])
+ *
+ * Parameters
+ * ^^^^^^^^^^
+ *   - cmd   : one of minimize, maximize, extrema, implicitdiff, minimax,
+ *             tpsolve, nlpsolve, thiele, triginterp, kernel_density
+ *   - sizes : list of problem sizes, each given as n or [n,m]
+ *   - reps  : (optional) number of repetitions per size (default 1)
+ *
+ * Problem families are the following (n is the size, m the number of
+ * constraints or sources):
+ *   - minimize, maximize : n variables, m random linear constraints
+ *   - nlpsolve           : as above, with bounds -10..10 and coupled objective
+ *   - extrema            : n variables, 2^n critical points
+ *   - implicitdiff       : derivative of order n of an implicit function
+ *   - minimax            : approximation of exp(x) on [0,1] by degree n
+ *   - tpsolve            : m sources (default m=n) and n destinations
+ *   - thiele, triginterp : n samples of a smooth function
+ *   - kernel_density     : n samples from a normal mixture, 100 bins
+ *
+ * The return value is a JSON string containing, for each size, the minimal
+ * and the mean wall time in nanoseconds, the profile of the last repetition
+ * (see 'optprofile') and the printed result.
+ *
+ * Examples
+ * ^^^^^^^^
+ * optbench(tpsolve,[5,10,20,[10,40]])
+ * optbench(kernel_density,[1000,10000,100000,1000000],3)
+ * optbench(minimax,[5,10,20,50])
+ */
+gen _optbench(const gen &g,GIAC_CONTEXT) {
+    if (g.type==_STRNG && g.subtype==-1) return g;
+    if (g.type!=_VECT || g.subtype!=_SEQ__VECT || g._VECTptr->size()<2 || g._VECTptr->size()>3)
+        return gentypeerr(contextptr);
+    const vecteur &gv=*g._VECTptr;
+    string cmd=gv[0].type==_STRNG?*gv[0]._STRNGptr:gv[0].print(contextptr);
+    if (gv[1].type!=_VECT)
+        return gentypeerr(contextptr);
+    int reps=1;
+    if (gv.size()==3) {
+        if (!gv[2].is_integer() || gv[2].val<1)
+            return gentypeerr(contextptr);
+        reps=gv[2].val;
+    }
+    // validate the command and the sizes before running anything
+    vector<pair<int,int> > sizes;
+    for (const_iterateur it=gv[1]._VECTptr->begin();it!=gv[1]._VECTptr->end();++it) {
+        int n,m=0;
+        if (it->is_integer())
+            n=it->val;
+        else if (it->type==_VECT && it->_VECTptr->size()==2 && it->_VECTptr->front().is_integer() &&
+                 it->_VECTptr->back().is_integer()) {
+            n=it->_VECTptr->front().val;
+            m=it->_VECTptr->back().val;
+        } else return gentypeerr(contextptr);
+        if (n<1 || m<0) {
+            *logptr(contextptr) << "Error: invalid problem size" << endl;
+            return gensizeerr(contextptr);
+        }
+        sizes.push_back(make_pair(n,m));
+    }
+    {
+        int m=0;
+        unsigned long long seed=0;
+        gen args;
+        if (optbench_problem(cmd,1,m,seed,args,contextptr)==NULL) {
+            *logptr(contextptr) << "Error: unsupported command " << cmd << endl;
+            return gensizeerr(contextptr);
+        }
+    }
+    bool profiling=opt_timer::is_enabled();
+    stringstream ss;
+    ss << "{\"command\":" << optbench_json_string(cmd) << ",\"runs\":[";
+    for (vector<pair<int,int> >::const_iterator it=sizes.begin();it!=sizes.end();++it) {
+        int n=it->first,m=it->second;
+        unsigned long long seed=n*1009+m;
+        gen args,res,prof;
+        optbench_command f=optbench_problem(cmd,n,m,seed,args,contextptr);
+        long long tmin=0,tsum=0;
+        for (int r=0;r<reps;++r) {
+            optcache::instance().clear();
+            opt_timer::enable(true);
+            std::chrono::steady_clock::time_point start=std::chrono::steady_clock::now();
+            try {
+                res=f(args,contextptr);
+            } catch (...) { // restore the profiler state before passing the error on
+                opt_timer::enable(profiling);
+                throw;
+            }
+            long long ns=std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now()-start).count();
+            prof=opt_timer::table();
+            tsum+=ns;
+            if (r==0 || ns<tmin)
+                tmin=ns;
+        }
+        if (it!=sizes.begin())
+            ss << ",";
+        ss << "{\"n\":" << n << ",\"m\":" << m << ",\"reps\":" << reps << ",\"min_ns\":" << tmin
+           << ",\"mean_ns\":" << tsum/reps << ",\"phases\":{";
+        const gen_map &pm=*prof._MAPptr;
+        for (gen_map::const_iterator pt=pm.begin();pt!=pm.end();++pt) {
+            const vecteur &cnt=*pt->second._VECTptr;
+            ss << (pt==pm.begin()?"":",") << optbench_json_string(*pt->first._STRNGptr)
+               << ":{\"calls\":" << cnt[0].print(contextptr) << ",\"ns\":" << cnt[1].print(contextptr) << "}";
+        }
+        ss << "},\"result\":" << optbench_json_string(res.print(contextptr)) << "}";
+    }
+    ss << "]}";
+    opt_timer::enable(profiling);
+    return string2gen(ss.str(),false);
+}
+static const char _optbench_s []="optbench";
+static define_unary_function_eval (__optbench,&_optbench,_optbench_s);
+define_unary_function_ptr5(at_optbench,alias_at_optbench,&__optbench,0,true)
+
+/*
+ * Compute the discrete Fourier transform X[k]=sum(x[j]*exp(-2*pi*i*j*k/n),j=0..n-1)
+ * of x in place, or the unnormalized inverse transform if inverse=true. The
+ * radix-2 algorithm is used when n is a power of two, otherwise the transform
+ * is computed as a power-of-two convolution by using Bluestein's algorithm.
+ */
+void fft_double(vector<complex<double> > &x,bool inverse=false) {
+    int n=x.size();
+    if (n<2)
+        return;
+    double sgn=inverse?1.0:-1.0;
+    if ((n & (n-1))==0) {
+        for (int i=1,j=0;i<n;++i) {
+            int bit=n>>1;
+            for (;j & bit;bit>>=1) j^=bit;
+            j^=bit;
+            if (i<j)
+                std::swap(x[i],x[j]);
+        }
+        vector<complex<double> > tw(n/2);
+        for (int k=0;k<n/2;++k) {
+            tw[k]=std::polar(1.0,sgn*2*M_PI*k/n);
+        }
+        complex<double> u,v;
+        for (int len=2;len<=n;len<<=1) {
+            int h=len/2,step=n/len;
+            for (int i=0;i<n;i+=len) {
+                for (int j=0;j<h;++j) {
+                    u=x[i+j];
+                    v=x[i+j+h]*tw[j*step];
+                    x[i+j]=u+v;
+                    x[i+j+h]=u-v;
+                }
             }
         }
+        return;
+    }
+    int m=1;
+    while (m<2*n-1) m<<=1;
+    vector<complex<double> > w(n),p(m,0.0),q(m,0.0);
+    for (int j=0;j<n;++j) {
+        w[j]=std::polar(1.0,sgn*M_PI*double((long long)j*j%(2LL*n))/n);
+        p[j]=x[j]*w[j];
+        q[j]=std::conj(w[j]);
+        if (j>0)
+            q[m-j]=q[j];
+    }
+    fft_double(p);
+    fft_double(q);
+    for (int k=0;k<m;++k) {
+        p[k]*=q[k];
+    }
+    fft_double(p,true);
+    for (int k=0;k<n;++k) {
+        x[k]=w[k]*p[k]/double(m);
+    }
+}
+
+/*
+ * Compute the coefficients A[j], B[j], j=0,1,..,N, and the angular frequency
+ * omega of the trigonometric polynomial
+ *
+ *      sum(A[j]*cos(j*omega*x)+B[j]*sin(j*omega*x),j=0..N)
+ *
+ * passing through points with ordinate components in 'data' and the abscissa
+ * components equally spaced between a and b (the first being equal a and the
+ * last being equal to b).
+ */
+void triginterp_coeffs(const vecteur &data,const gen &a,const gen &b,vecteur &A,vecteur &B,gen &omega,GIAC_CONTEXT) {
+    opt_timer timer("triginterp_coeffs");
+    int n=data.size(),N=n/2,h=(n-1)/2;
+    gen T=(b-a)*fraction(n,n-1),twopi=2*_IDNT_pi();
+    /* The sum of data[k]*exp(i*j*omega*(a+k*T/n)) is exp(i*j*omega*a) times an element
+     * of the cyclotomic field Q(z), z=exp(2*pi*i/n). In the basis 1,z,..,z^(n-1) its
+     * coordinates are C[e]=sum(data[k],j*k=e mod n), hence the exact DFT needs only
+     * additions. The coordinates are mapped to the real and imaginary parts by using
+     * the conjugate pairs z^e,z^(n-e), whose cosines and sines are computed once. */
+    vecteur cs(h+1),sn(h+1),C(n);
+    for (int e=1;e<=h;++e) {
+        cs[e]=cos(fraction(2*e,n)*cst_pi,contextptr);
+        sn[e]=sin(fraction(2*e,n)*cst_pi,contextptr);
+    }
+    A.resize(N+1);
+    B.resize(N+1);
+    A[0]=_mean(data,contextptr);
+    B[0]=0;
+    for (int j=1;j<=N;++j) {
+        std::fill(C.begin(),C.end(),gen(0));
+        for (int k=0,e=0;k<n;++k,e=(e+j)%n) {
+            C[e]+=data[k];
+        }
+        gen U(C[0]),V(0);
+        if ((n%2)==0)
+            U-=C[N];
+        for (int e=1;e<=h;++e) {
+            U+=(C[e]+C[n-e])*cs[e];
+            V+=(C[e]-C[n-e])*sn[e];
+        }
+        gen c=fraction(((n%2)==0 && j==N)?1:2,n),theta=_ratnormal(j*twopi*a/T,contextptr);
+        gen ct=cos(theta,contextptr),st=sin(theta,contextptr);
+        A[j]=c*(ct*U-st*V);
+        B[j]=c*(st*U+ct*V);
     }
-    if (constr.empty()) {
-        *logptr(contextptr) << "Error: no contraints detected" << endl;
-        return gensizeerr(contextptr);
+    // simplify all coefficients at once
+    vecteur AB=*_simplify(mergevecteur(A,B),contextptr)._VECTptr;
+    A.assign(AB.begin(),AB.begin()+N+1);
+    B.assign(AB.begin()+N+1,AB.end());
+    omega=_ratnormal(twopi/T,contextptr);
+}
+
+/*
+ * Numeric version of 'triginterp_coeffs', which obtains all coefficients from
+ * a single FFT of the data.
+ */
+void triginterp_coeffs(const vector<double> &data,double a,double b,vector<double> &A,vector<double> &B,double &omega) {
+    opt_timer timer("triginterp_coeffs");
+    int n=data.size(),N=n/2;
+    double T=(b-a)*n/(n-1.0);
+    vector<complex<double> > Y(data.begin(),data.end());
+    fft_double(Y);
+    A.resize(N+1);
+    B.assign(N+1,0.0);
+    A[0]=Y[0].real()/n;
+    for (int j=1;j<=N;++j) {
+        // sum(data[k]*exp(i*j*omega*(a+k*T/n)),k=0..n-1)=exp(i*j*omega*a)*conj(Y[j])
+        complex<double> S=std::polar(((n%2)==0 && j==N)?1.0/n:2.0/n,2*M_PI*j*a/T)*std::conj(Y[j]);
+        A[j]=S.real();
+        B[j]=S.imag();
     }
-    bool feasible=true;
-    for (it=constr.begin();it!=constr.end();++it) {
-        if (it->is_symb_of_sommet(at_equal)) {
-            gen expr=_equal2diff(*it,contextptr);
-            if (!is_zero(_subs(makesequence(expr,vars,initp),contextptr))) {
-                feasible=false;
-                break;
-            }
-        } else if (it->is_symb_of_sommet(at_inferieur_egal) || it->is_symb_of_sommet(at_superieur_egal)) {
-            if (_evalb(_subs(makesequence(*it,vars,initp),contextptr),contextptr).val==0) {
-                feasible=false;
-                break;
-            }
-        } else {
-            *logptr(contextptr) << "Error: unrecognized constraint " << *it << endl;
-            return gentypeerr(contextptr);
+    omega=2*M_PI/T;
+}
+
+/*
+ * Return the trigonometric polynomial in x with coefficients A, B and angular
+ * frequency omega (see 'triginterp_coeffs').
+ */
+gen trigpoly(const vecteur &A,const vecteur &B,const gen &omega,const gen &x,GIAC_CONTEXT) {
+    gen tp=A.front();
+    for (int j=1;j<int(A.size());++j) {
+        gen wj=_ratnormal(j*omega,contextptr);
+        tp+=A[j]*cos(wj*x,contextptr);
+        tp+=B[j]*sin(wj*x,contextptr);
+    }
+    return tp;
+}
+
+/*
+ * Differentiate the trigonometric polynomial with coefficients A, B and angular
+ * frequency omega r times by spectral differentiation, i.e. by multiplying
+ * A[j]-i*B[j] with (i*j*omega)^r.
+ */
+void trigpoly_derive(vecteur &A,vecteur &B,const gen &omega,int r,GIAC_CONTEXT) {
+    if (r<1)
+        return;
+    A.front()=0;
+    for (int j=1;j<int(A.size());++j) {
+        gen f=_ratnormal(pow(j*omega,r),contextptr),a=A[j],b=B[j];
+        switch (r%4) {
+        case 0: A[j]=f*a; B[j]=f*b; break;
+        case 1: A[j]=f*b; B[j]=-f*a; break;
+        case 2: A[j]=-f*a; B[j]=-f*b; break;
+        case 3: A[j]=-f*b; B[j]=f*a; break;
         }
     }
-    gen sol,optval;
-    try {
-        if (!feasible) {
-            initp=*_fMin(makesequence(gen(0),constr,vars,initp),contextptr)._VECTptr;
-            if (is_undef(initp) || initp.empty()) {
-                *logptr(contextptr) << "Error: unable to generate a feasible initial point" << endl;
-                return undef;
-            }
-            *logptr(contextptr) << "Using a generated feasible initial point " << initp << endl;
+}
+
+/*
+ * Evaluate the trigonometric polynomial sum(re(c[j]*exp(i*j*omega*x)),j=0..N)
+ * at the points t. Horner's scheme in exp(i*omega*t) is used, hence only one
+ * complex exponential is computed per point.
+ */
+void trigpoly_eval(const vector<complex<double> > &c,double omega,const vector<double> &t,vector<double> &res) {
+    int N=c.size()-1;
+    res.resize(t.size());
+    complex<double> z,p;
+    for (int k=0;k<int(t.size());++k) {
+        z=std::polar(1.0,omega*t[k]);
+        p=c[N];
+        for (int j=N;j-->0;) {
+            p=p*z+c[j];
         }
-        gen args=makesequence(obj,constr,vars,initp,gen(eps),gen(maxiter));
-        if (maximize)
-            sol=_fMax(args,contextptr);
-        else
-            sol=_fMin(args,contextptr);
-    } catch (std::runtime_error &err) {
-        *logptr(contextptr) << "Error: " << err.what() << endl;
-        return undef;
+        res[k]=p.real();
     }
-    if (is_undef(sol))
-        return undef;
-    optval=_subs(makesequence(obj,vars,sol),contextptr);
-    return gen(makevecteur(optval,_zip(makesequence(at_equal,vars,sol),contextptr)),_LIST__VECT);
 }
-static const char _nlpsolve_s []="nlpsolve";
-static define_unary_function_eval (__nlpsolve,&_nlpsolve,_nlpsolve_s);
-define_unary_function_ptr5(at_nlpsolve,alias_at_nlpsolve,&__nlpsolve,0,true)
 
 /*
- * Returns the trigonometric polynomial in variable x passing through points
- * with ordinate componets in 'data' and the abscissa components equally spaced between
- * a and b (the first being equal a and the last being equal to b).
+ * Evaluate the trigonometric polynomial from 'trigpoly_eval' at M equally
+ * spaced points a+2*pi*k/(M*omega), k=0,1,..,M-1, spanning one period, by
+ * using the zero-padded inverse FFT of its coefficients.
  */
-gen triginterp(const vecteur &data,const gen &a,const gen &b,const identificateur &x,GIAC_CONTEXT) {
-    int n=data.size();
-    if (n<2)
-        return gensizeerr(contextptr);
-    int N=(n%2)==0?n/2:(n-1)/2;
-    gen T=(b-a)*fraction(n,n-1),twopi=2*_IDNT_pi(),X;
-    matrice cos_coeff=*_matrix(makesequence(N,n,0),contextptr)._VECTptr;
-    matrice sin_coeff=*_matrix(makesequence(N,n,0),contextptr)._VECTptr;
+void trigpoly_eval_grid(const vector<complex<double> > &c,double omega,double a,int M,vector<double> &res) {
+    vector<complex<double> > G(M,0.0);
+    for (int j=0;j<int(c.size());++j) {
+        G[j%M]+=c[j]*std::polar(1.0,j*omega*a);
+    }
+    fft_double(G,true);
+    res.resize(M);
+    for (int k=0;k<M;++k) {
+        res[k]=G[k].real();
+    }
+}
+
+/*
+ * Compute F[l+M]=sum(w[k]*exp(-i*l*t[k]),k=0..n-1) for l=-M,..,M, where t[k]
+ * are in [0,2*pi), by Gaussian gridding (type-1 nonuniform FFT). The points
+ * are spread to an oversampled regular grid with a Gaussian kernel, the grid
+ * is transformed by FFT and the result is deconvolved.
+ *
+ * Source: L. Greengard and J.-Y. Lee, Accelerating the nonuniform fast Fourier
+ *         transform, SIAM Review 46 (2004), 443-454.
+ */
+void nufft1(const vector<double> &t,const vector<complex<double> > &w,int M,vector<complex<double> > &F) {
+    opt_timer timer("nufft1");
+    int K=2*M+1,Mr=2,Msp=12;
+    while (Mr<2*K) Mr<<=1;
+    double R=double(Mr)/K,tau=M_PI*Msp/(double(K)*K*R*(R-0.5)),h=2*M_PI/Mr,u;
+    vector<complex<double> > f(Mr,0.0);
+    for (int k=0;k<int(t.size());++k) {
+        int m0=(int)std::floor(t[k]/h);
+        double d=t[k]-m0*h;
+        for (int m=1-Msp;m<=Msp;++m) {
+            u=m*h-d;
+            f[((m0+m)%Mr+Mr)%Mr]+=w[k]*std::exp(-u*u/(4*tau));
+        }
+    }
+    fft_double(f);
+    F.resize(K);
+    double fac=std::sqrt(M_PI/tau)/Mr;
+    for (int l=-M;l<=M;++l) {
+        F[l+M]=fac*std::exp(l*l*tau)*f[(l+Mr)%Mr];
+    }
+}
+
+/*
+ * Compute the coefficients A[j], B[j], j=0,1,..,N, of the trigonometric
+ * polynomial sum(A[j]*cos(j*omega*x)+B[j]*sin(j*omega*x),j=0..N) which fits
+ * the points (xv[k],yv[k]) in the least-squares sense. The matrix of the
+ * normal equations for the complex coefficients c[-N],..,c[N] is Hermitian
+ * Toeplitz with entries S[l-j]=sum(exp(-i*(l-j)*omega*xv[k]),k), which are
+ * obtained, together with the right-hand side, by type-1 NUFFT. The system is
+ * solved by the conjugate gradient method, computing the matrix-vector
+ * products by FFT of the circulant embedding in O(N*log(N)) time. Return false
+ * if the method did not converge.
+ */
+bool trigfit_coeffs(const vector<double> &xv,const vector<double> &yv,int N,double omega,
+                    vector<double> &A,vector<double> &B,double tol=1e-12) {
+    int n=xv.size(),K=2*N+1,P=1;
+    vector<double> t(n);
     for (int k=0;k<n;++k) {
-        X=twopi*(a/T+fraction(k,n));
-        for (int j=1;j<=N;++j) {
-            cos_coeff[j-1]._VECTptr->at(k)=cos(j*X,contextptr);
-            sin_coeff[j-1]._VECTptr->at(k)=sin(j*X,contextptr);
+        t[k]=omega*xv[k];
+        t[k]-=2*M_PI*std::floor(t[k]/(2*M_PI));
+    }
+    vector<complex<double> > S,rhs,ones(n,1.0),yc(yv.begin(),yv.end());
+    nufft1(t,ones,2*N,S);
+    nufft1(t,yc,N,rhs);
+    while (P<2*K-1) P<<=1;
+    vector<complex<double> > g(P,0.0),v(P);
+    for (int m=0;m<=2*N;++m) {
+        g[m]=S[2*N+m];
+        if (m>0)
+            g[P-m]=S[2*N-m];
+    }
+    fft_double(g);
+    vector<complex<double> > c(K,0.0),r(rhs),p(rhs),Ap(K);
+    double rs=0,bnrm,rs_new;
+    for (int l=0;l<K;++l) rs+=std::norm(r[l]);
+    bnrm=std::sqrt(rs);
+    bool converged=bnrm==0;
+    for (int iter=0;!converged && iter<10*K+100;++iter) {
+        // Ap=T*p
+        std::fill(v.begin(),v.end(),0.0);
+        std::copy(p.begin(),p.end(),v.begin());
+        fft_double(v);
+        for (int m=0;m<P;++m) v[m]*=g[m];
+        fft_double(v,true);
+        complex<double> pAp=0;
+        for (int l=0;l<K;++l) {
+            Ap[l]=v[l]/double(P);
+            pAp+=std::conj(p[l])*Ap[l];
+        }
+        if (pAp.real()<=0)
+            break;
+        double alpha=rs/pAp.real();
+        rs_new=0;
+        for (int l=0;l<K;++l) {
+            c[l]+=alpha*p[l];
+            r[l]-=alpha*Ap[l];
+            rs_new+=std::norm(r[l]);
+        }
+        if (std::sqrt(rs_new)<=tol*bnrm)
+            converged=true;
+        for (int l=0;l<K;++l) {
+            p[l]=r[l]+(rs_new/rs)*p[l];
         }
+        rs=rs_new;
     }
-    gen tp=_mean(data,contextptr);
-    for (int j=0;j<N;++j) {
-        gen c=fraction(((n%2)==0 && j==N-1)?1:2,n);
-        gen ak=_evalc(trig2exp(scalarproduct(data,*cos_coeff[j]._VECTptr,contextptr),contextptr),contextptr);
-        gen bk=_evalc(trig2exp(scalarproduct(data,*sin_coeff[j]._VECTptr,contextptr),contextptr),contextptr);
-        tp+=_simplify(c*ak,contextptr)*cos(_ratnormal((j+1)*twopi/T,contextptr)*x,contextptr);
-        tp+=_simplify(c*bk,contextptr)*sin(_ratnormal((j+1)*twopi/T,contextptr)*x,contextptr);
+    A.resize(N+1);
+    B.resize(N+1);
+    A[0]=c[N].real();
+    B[0]=0;
+    for (int j=1;j<=N;++j) {
+        A[j]=(c[N+j]+c[N-j]).real();
+        B[j]=-(c[N+j]-c[N-j]).imag();
     }
-    return tp;
+    return converged;
 }
 
+/*
+ * 'triginterp' returns the trigonometric polynomial passing through the given
+ * points with equally spaced abscissas.
+ *
+ * Usage
+ * ^^^^^
+ *      triginterp(data,x=a..b,[opts])
+ * or   triginterp(data,a,b,x,[opts])
+ * or   triginterp(points,x=a..b,N,[opts])
+ * or   triginterp(data_x,data_y,x=a..b,N,[opts])
+ *
+ * Parameters
+ * ^^^^^^^^^^
+ *      - data      : list of ordinates [y1,y2,...,yn] (n>=2)
+ *      - x         : identifier
+ *      - a,b       : the first and the last abscissa
+ *      - points    : list of points [[x1,y1],[x2,y2],...,[xn,yn]]
+ *      - data_x    : list of abscissas [x1,x2,...,xn]
+ *      - data_y    : list of ordinates [y1,y2,...,yn]
+ *      - N         : number of harmonics (nonnegative integer)
+ *      - opts      : sequence of options
+ *
+ * In the first two forms, the abscissas are equally spaced between a and b. If
+ * the data is numeric, all coefficients are obtained from a single FFT of the
+ * data.
+ *
+ * In the last two forms, the abscissas may be arbitrary (e.g. irregularly
+ * sampled data) and the trigonometric polynomial of degree N with period b-a,
+ * which fits the points in the least-squares sense, is returned. At least
+ * 2N+1 points are required. The normal equations are solved by the conjugate
+ * gradient method accelerated by nonuniform FFT.
+ *
+ * By setting the
+ * option 'output=coeff', the sequence A,B,w is returned instead of the
+ * polynomial, where A and B are lists of length N+1 such that the polynomial
+ * is equal to sum(A[j]*cos(j*w*x)+B[j]*sin(j*w*x),j=0..N).
+ *
+ * The option 'diff=<posint>' specifies the order of the derivative of the
+ * polynomial to be returned instead of the polynomial itself. It is computed
+ * by spectral differentiation.
+ *
+ * By setting the option 'eval=L', where L is a list of reals, the polynomial
+ * (or its derivative) is evaluated at the elements of L and the list of values
+ * is returned. This is much faster than substituting into the polynomial. If
+ * L is a positive integer M, the values at M equally spaced points spanning
+ * one period, starting at a, are computed by inverse FFT.
+ *
+ * Examples
+ * ^^^^^^^^
+ * triginterp([11,10,17,24,32,26,23,19],x=0..21)
+ * triginterp([11.0,10,17,24,32,26,23,19],0,21,x,output=coeff)
+ * triginterp([11.0,10,17,24,32,26,23,19],x=0..21,eval=[1.5,2.5,3.5])
+ * triginterp([11.0,10,17,24,32,26,23,19],x=0..21,diff=1,eval=64)
+ * X:=sort(randvector(1000,uniform,0,10)):;Y:=sin(X)+0.1*randvector(1000,normald,0,1):;
+ * triginterp(X,Y,x=0..10,5)
+ */
 gen _triginterp(const gen &g,GIAC_CONTEXT) {
     if (g.type==_STRNG && g.subtype==-1) return g;
+    opt_timer timer("triginterp");
     if (g.type!=_VECT || g.subtype!=_SEQ__VECT)
         return gentypeerr(contextptr);
     vecteur &args=*g._VECTptr;
@@ -2528,21 +6219,128 @@ gen _triginterp(const gen &g,GIAC_CONTEXT) {
         return gensizeerr(contextptr);
     if (args.front().type!=_VECT)
         return gentypeerr(contextptr);
-    vecteur &data=*args.front()._VECTptr;
-    gen x,ab,a,b,&vararg=args.at(1);
+    vecteur data,xv;
+    bool uniform=!ckmatrix(args.front()) && args.at(1).type!=_VECT;
+    int di=1,oi,nh=0;
+    if (uniform)
+        data=*args.front()._VECTptr;
+    else if ((di=parse_xydata(args,xv,data))<0 || di>=int(args.size()))
+        return gensizeerr(contextptr);
+    gen x,ab,a,b,&vararg=args.at(di);
     if (vararg.is_symb_of_sommet(at_equal) &&
                (x=_lhs(vararg,contextptr)).type==_IDNT &&
                (ab=_rhs(vararg,contextptr)).is_symb_of_sommet(at_interval)) {
         a=_lhs(ab,contextptr);
         b=_rhs(ab,contextptr);
-    } else if (args.size()==4 && (x=args.back()).type==_IDNT) {
+        oi=di+1;
+    } else if (uniform && args.size()>=4 && (x=args.at(3)).type==_IDNT) {
         a=args.at(1);
         b=args.at(2);
+        oi=4;
     } else return gensizeerr(contextptr);
-    gen tp=triginterp(data,a,b,*x._IDNTptr,contextptr);
-    if (is_approx(data) || is_approx(a) || is_approx(b))
-        tp=_evalf(tp,contextptr);
-    return tp;
+    if (!uniform) {
+        // get the number of harmonics
+        if (oi>=int(args.size()) || args[oi].type!=_INT_ || (nh=args[oi].val)<0)
+            return gensizeerr(contextptr);
+        ++oi;
+    }
+    bool coeffs=false;
+    int order=0;
+    gen pts=undef;
+    for (const_iterateur it=args.begin()+oi;it!=args.end();++it) {
+        if (!it->is_symb_of_sommet(at_equal))
+            return gensizeerr(contextptr);
+        gen &opt=it->_SYMBptr->feuille._VECTptr->front();
+        gen &v=it->_SYMBptr->feuille._VECTptr->back();
+        if ((opt==at_output || opt==at_Output) && is_option(v,"coeff",contextptr))
+            coeffs=true;
+        else if (is_option(opt,"diff",contextptr) || is_option(opt,"derive",contextptr)) {
+            if (v.type!=_INT_ || (order=v.val)<0)
+                return gensizeerr(contextptr);
+        } else if (opt==at_eval) {
+            if ((v.type!=_VECT && v.type!=_INT_) || (v.type==_INT_ && v.val<1))
+                return gensizeerr(contextptr);
+            pts=v;
+        } else return gensizeerr(contextptr);
+    }
+    if (data.size()<2)
+        return gensizeerr(contextptr);
+    vecteur A,B;
+    gen omega;
+    vector<double> ddata,dA,dB;
+    gen ea=_evalf(a,contextptr),eb=_evalf(b,contextptr);
+    bool approx=is_approx(data) || is_approx(a) || is_approx(b);
+    if (!uniform) {
+        vector<double> dxv;
+        if (ea.type!=_DOUBLE_ || eb.type!=_DOUBLE_ || !is_strictly_greater(eb,ea,contextptr) ||
+                !vecteur2doubles(xv,dxv,contextptr) || !vecteur2doubles(data,ddata,contextptr))
+            return gensizeerr(contextptr);
+        if (int(dxv.size())<2*nh+1) {
+            *logptr(contextptr) << "Error: at least " << 2*nh+1 << " points are required" << endl;
+            return gensizeerr(contextptr);
+        }
+        double w=2*M_PI/(eb.DOUBLE_val()-ea.DOUBLE_val());
+        if (!trigfit_coeffs(dxv,ddata,nh,w,dA,dB))
+            *logptr(contextptr) << "Warning: the least-squares solver did not converge" << endl;
+        A.resize(dA.size());
+        B.resize(dB.size());
+        for (int j=0;j<int(dA.size());++j) {
+            A[j]=gen(dA[j]);
+            B[j]=gen(dB[j]);
+        }
+        omega=gen(w);
+    } else if (approx && ea.type==_DOUBLE_ && eb.type==_DOUBLE_ && vecteur2doubles(data,ddata,contextptr)) {
+        double w;
+        triginterp_coeffs(ddata,ea.DOUBLE_val(),eb.DOUBLE_val(),dA,dB,w);
+        A.resize(dA.size());
+        B.resize(dB.size());
+        for (int j=0;j<int(dA.size());++j) {
+            A[j]=gen(dA[j]);
+            B[j]=gen(dB[j]);
+        }
+        omega=gen(w);
+    } else {
+        triginterp_coeffs(data,a,b,A,B,omega,contextptr);
+        if (approx) {
+            A=*_evalf(A,contextptr)._VECTptr;
+            B=*_evalf(B,contextptr)._VECTptr;
+            omega=_evalf(omega,contextptr);
+        }
+    }
+    trigpoly_derive(A,B,omega,order,contextptr);
+    if (coeffs)
+        return makesequence(A,B,omega);
+    if (!is_undef(pts)) {
+        vector<double> dt,val;
+        gen w=_evalf(omega,contextptr);
+        if (vecteur2doubles(A,dA,contextptr) && vecteur2doubles(B,dB,contextptr) && w.type==_DOUBLE_ &&
+                (pts.type==_INT_?ea.type==_DOUBLE_:vecteur2doubles(*pts._VECTptr,dt,contextptr))) {
+            vector<complex<double> > c(dA.size());
+            for (int j=0;j<int(c.size());++j) {
+                c[j]=complex<double>(dA[j],-dB[j]);
+            }
+            if (pts.type==_INT_)
+                trigpoly_eval_grid(c,w.DOUBLE_val(),ea.DOUBLE_val(),pts.val,val);
+            else trigpoly_eval(c,w.DOUBLE_val(),dt,val);
+            vecteur res(val.size());
+            for (int k=0;k<int(val.size());++k) {
+                res[k]=gen(val[k]);
+            }
+            return res;
+        }
+        // symbolic coefficients, substitute the points into the polynomial
+        gen tp=trigpoly(A,B,omega,x,contextptr);
+        vecteur res;
+        if (pts.type==_INT_) {
+            for (int k=0;k<pts.val;++k) {
+                res.push_back(_ratnormal(subst(tp,x,a+k*2*_IDNT_pi()/(pts.val*omega),false,contextptr),contextptr));
+            }
+        } else for (const_iterateur it=pts._VECTptr->begin();it!=pts._VECTptr->end();++it) {
+            res.push_back(_ratnormal(subst(tp,x,*it,false,contextptr),contextptr));
+        }
+        return res;
+    }
+    return trigpoly(A,B,omega,x,contextptr);
 }
 static const char _triginterp_s []="triginterp";
 static define_unary_function_eval (__triginterp,&_triginterp,_triginterp_s);
@@ -2551,6 +6349,7 @@ define_unary_function_ptr5(at_triginterp,alias_at_triginterp,&__triginterp,0,tru
 /* select a good bandwidth for kernel density estimation using a direct plug-in method (DPI),
  * Gaussian kernel is assumed */
 double select_bandwidth_dpi(const vector<double> &data,double sd) {
+    opt_timer timer("select_bandwidth_dpi");
     int n=data.size();
     double g6=1.23044723*sd,s=0,t,t2;
     for (vector<double>::const_iterator it=data.begin();it!=data.end();++it) {
@@ -2599,48 +6398,143 @@ double select_bandwidth_dpi_bins(int n,const vecteur &c,double d,double sd,GIAC_
     return std::pow(double(n)/(M_SQRT2*s),0.2)*g4;
 }
 
-/* kernel density estimation with Gaussian kernel */
-gen kernel_density(const vector<double> &data,double bw,double sd,int bins,double a,double b,int interp,const gen &x,GIAC_CONTEXT) {
+/* smooth v by recursive Gaussian filtering with standard deviation sigma (in samples, at least 0.5),
+ * using the fourth-order filter of Deriche as the sum of a causal and an anticausal pass. The
+ * values outside v are assumed to be zero. The cost is O(size(v)) regardless of sigma. */
+void recursive_gaussian(vector<double> &v,double sigma) {
+    assert(sigma>=0.5);
+    static const double A[2]={1.6800,-0.6803},B[2]={3.7350,-0.2598},W[2]={0.6318,1.9970},L[2]={-1.7830,-1.7230};
+    /* the impulse response for k>=0 is sum(c[j]*z[j]^k,j=0..3), the poles come in conjugate pairs */
+    complex<double> z[4],c[4],S(0),D[5]={1.0,0.0,0.0,0.0,0.0},N[5],M[5];
+    for (int j=0;j<2;++j) {
+        z[2*j+1]=conj(z[2*j]=std::exp(complex<double>(L[j],W[j])/sigma));
+        c[2*j+1]=conj(c[2*j]=complex<double>(A[j],-B[j])/2.0);
+    }
+    for (int j=0;j<4;++j) {
+        S+=c[j]*(1.0+z[j])/(1.0-z[j]);
+    }
+    for (int j=0;j<4;++j) { // normalize to unit gain and compute the transfer functions
+        c[j]/=S.real();
+        for (int k=j+1;k>0;--k) D[k]-=z[j]*D[k-1];
+        complex<double> P[4]={1.0,0.0,0.0,0.0};
+        for (int i=0,deg=0;i<4;++i) {
+            if (i==j) continue;
+            ++deg;
+            for (int k=deg;k>0;--k) P[k]-=z[i]*P[k-1];
+        }
+        for (int k=0;k<4;++k) {
+            N[k]+=c[j]*P[k];
+            M[k+1]+=c[j]*z[j]*P[k];
+        }
+    }
+    int n=v.size();
+    vector<double> yc(n+4,0.0),ya(n+4,0.0),x(n+8,0.0);
+    std::copy(v.begin(),v.end(),x.begin()+4);
+    for (int i=0;i<n;++i) { // causal pass, x and yc are shifted by 4
+        double &y=yc[i+4];
+        for (int k=0;k<4;++k) y+=N[k].real()*x[i+4-k];
+        for (int k=1;k<5;++k) y-=D[k].real()*yc[i+4-k];
+    }
+    for (int i=n;i-->0;) { // anticausal pass
+        double &y=ya[i];
+        for (int k=1;k<5;++k) y+=M[k].real()*x[i+4+k]-D[k].real()*ya[i+k];
+        v[i]=yc[i+4]+y;
+    }
+}
+
+/* smooth the values c binned with width d by the Gaussian kernel with bandwidth bw, scaled by
+ * scale/(bw*sqrt(2*pi)), using either convolution or recursive filtering */
+gen kde_smooth(const vecteur &c,double bw,double d,double scale,int smoothing,GIAC_CONTEXT) {
+    int bins=c.size();
+    if (smoothing==_KDE_SMOOTH_RECURSIVE && bw/d>=0.5) { // recursive filtering, O(bins) for any bandwidth
+        vector<double> v(bins);
+        for (int i=0;i<bins;++i) {
+            v[i]=c[i].type==_INT_?double(c[i].val):c[i].DOUBLE_val();
+        }
+        recursive_gaussian(v,bw/d);
+        vecteur y(bins);
+        for (int i=0;i<bins;++i) {
+            y[i]=v[i]*scale/d;
+        }
+        return y;
+    }
+    // convolution with the kernel sampled on 2L+1 points
+    int L=std::min(bins-1,(int)std::floor(1+4*bw/d));
+    vecteur k(2*L+1);
+    for (int i=0;i<=2*L;++i) {
+        k[i]=gen(scale/(bw*std::sqrt(2.0*M_PI))*std::exp(-std::pow(d*double(i-L)/bw,2)/2.0));
+    }
+    return _mid(makesequence(_convolution(makesequence(c,k),contextptr),L,bins),contextptr);
+}
+
+/* count the data in the bins centered at a+k*d for k=0,1,...,bins-1, the responses yv (if given) are summed in cy */
+void kde_bin(const vector<double> &data,const vector<double> *yv,int bins,double a,double d,vecteur &c,vecteur &cy) {
+    c=vecteur(bins,0);
+    cy=vecteur(yv==NULL?0:bins,0);
+    int index;
+    for (vector<double>::const_iterator it=data.begin();it!=data.end();++it) {
+        index=(int)((*it-a)/d+0.5);
+        if (index>=0 && index<bins) {
+            c[index]+=1;
+            if (yv!=NULL)
+                cy[index]+=yv->at(it-data.begin());
+        }
+    }
+}
+
+/* kernel density estimation with Gaussian kernel, the selected bandwidth is returned in bw.
+ * If yv is not NULL, Nadaraya-Watson estimate of the regression of yv on data is returned instead,
+ * as the ratio of the smoothed sums of yv and the smoothed counts. */
+gen kernel_density(const vector<double> &data,double &bw,double sd,int bins,double a,double b,int interp,const gen &x,
+                   int smoothing,const vector<double> *yv,GIAC_CONTEXT) {
+    opt_timer timer("kernel_density (estimate)");
     int n=data.size();
     double SQRT_2PI=std::sqrt(2.0*M_PI);
+    gen outside=yv==NULL?gen(0):undef;
     if (bins<=0) { // return density as a sum of exponential functions, usable for up to few hundred samples
         if (bw<=0)
             bw=select_bandwidth_dpi(data,sd);
         double fac=bw*n*SQRT_2PI;
-        gen res(0),h(2.0*bw*bw);
+        gen res(0),ys(0),h(2.0*bw*bw),k;
         for (vector<double>::const_iterator it=data.begin();it!=data.end();++it) {
-            res+=exp(-pow(x-gen(*it),2)/h,contextptr);
+            res+=(k=exp(-pow(x-gen(*it),2)/h,contextptr));
+            if (yv!=NULL)
+                ys+=gen(yv->at(it-data.begin()))*k;
         }
-        return res/gen(fac);
+        return yv==NULL?res/gen(fac):ys/res;
     }
     /* FFT method, constructs an approximation on [a,b] with the specified number of bins.
      * If interp>0, interpolation of order interp is performed and the density is returned piecewise. */
     assert(b>a && bins>0);
     double d=(b-a)/(bins-1);
-    vecteur c(bins,0);
-    int index;
-    for (vector<double>::const_iterator it=data.begin();it!=data.end();++it) {
-        index=(int)((*it-a)/d+0.5);
-        if (index>=0 && index<bins) c[index]+=1;
-    }
+    vecteur c,cy;
+    kde_bin(data,yv,bins,a,d,c,cy);
     if (bw<=0) { // select bandwidth
         if (n<=1000)
             bw=select_bandwidth_dpi(data,sd);
         else bw=select_bandwidth_dpi_bins(n,c,d,sd,contextptr);
         *logptr(contextptr) << "selected bandwidth: " << bw << endl;
     }
-    int L=std::min(bins-1,(int)std::floor(1+4*bw/d));
-    vecteur k(2*L+1);
-    for (int i=0;i<=2*L;++i) {
-        k[i]=gen(1.0/(n*bw*SQRT_2PI)*std::exp(-std::pow(d*double(i-L)/bw,2)/2.0));
+    gen res=kde_smooth(c,bw,d,yv==NULL?1.0/n:1.0,smoothing,contextptr);
+    if (yv!=NULL) { // divide the smoothed sums by the smoothed counts, undefined where there are no data
+        vecteur &den=*res._VECTptr,num=*kde_smooth(cy,bw,d,1.0,smoothing,contextptr)._VECTptr;
+        double dmax=_evalf(_max(den,contextptr),contextptr).DOUBLE_val();
+        for (int i=0;i<bins;++i) {
+            double di=_evalf(den[i],contextptr).DOUBLE_val();
+            den[i]=di>1e-10*dmax?num[i]/gen(di):undef;
+        }
+    } else if (smoothing==_KDE_SMOOTH_RECURSIVE) { // remove small negative values
+        for (iterateur it=res._VECTptr->begin();it!=res._VECTptr->end();++it) {
+            if (is_strictly_positive(-*it,contextptr))
+                *it=0.0;
+        }
     }
-    gen res=_mid(makesequence(_convolution(makesequence(c,k),contextptr),L,bins),contextptr);
     if (interp>0) { // interpolate the obtained points
         int pos0=0;
         if (x.type!=_IDNT) {
             double xd=_evalf(x,contextptr).DOUBLE_val();
             if (xd<a || xd>=b || (pos0=std::floor((xd-a)/d))>bins-2)
-                return 0;
+                return outside;
             if (interp==1) {
                 gen &y1=res._VECTptr->at(pos0),&y2=res._VECTptr->at(pos0+1),x1=a+pos0*d;
                 return y1+(x-x1)*(y2-y1)/gen(d);
@@ -2649,27 +6543,262 @@ gen kernel_density(const vector<double> &data,double bw,double sd,int bins,doubl
         vecteur pos(bins);
         for (int i=0;i<bins;++i) pos[i]=a+d*i;
         identificateur X=x.type==_IDNT?*x._IDNTptr:identificateur(" X");
-        vecteur p=*_spline(makesequence(pos,res,X,interp),contextptr)._VECTptr;
+        /* interpolate each maximal run of defined values separately, so that the cells with no data
+         * (in kernel regression) remain undefined without affecting the rest of the estimate */
+        vecteur p(bins-1,undef);
+        const vecteur &rv=*res._VECTptr;
+        for (int i=0,j;i<bins;i=j+1) {
+            j=i;
+            if (is_undef(rv[i]))
+                continue;
+            while (j+1<bins && !is_undef(rv[j+1])) ++j;
+            if (j==i)
+                continue;
+            vecteur q=*_spline(makesequence(vecteur(pos.begin()+i,pos.begin()+j+1),vecteur(rv.begin()+i,rv.begin()+j+1),
+                                            X,std::min(interp,j-i)),contextptr)._VECTptr;
+            std::copy(q.begin(),q.end(),p.begin()+i);
+        }
         vecteur args(0);
         if (x.type==_IDNT)
             args.reserve(2*bins+1);
         for (int i=0;i<bins;++i) {
             if (x.type==_IDNT) {
                 args.push_back(i+1<bins?symb_inferieur_strict(X,pos[i]):symb_inferieur_egal(X,pos[i]));
-                args.push_back(i==0?gen(0):p[i-1]);
+                args.push_back(i==0?outside:p[i-1]);
             } else if (i==pos0) res=_ratnormal(_subst(makesequence(p[i],X,x),contextptr),contextptr);
-            if (i+1<bins && !_solve(makesequence(p[i],symb_equal(X,symb_interval(pos[i],pos[i+1]))),contextptr)._VECTptr->empty())
+            if (yv==NULL && i+1<bins && !_solve(makesequence(p[i],symb_equal(X,symb_interval(pos[i],pos[i+1]))),contextptr)._VECTptr->empty())
                 *logptr(contextptr) << "Warning: interpolated density has negative values in ["
                                     << pos[i] << "," << pos[i+1] << "]" << endl;
         }
         if (x.type!=_IDNT) return res;
-        args.push_back(0);
+        args.push_back(outside);
         res=symbolic(at_piecewise,change_subtype(args,_SEQ__VECT));
         return res;
     }
     return res;
 }
 
+/* compute the cumulative distribution from the density y binned on the grid a+i*d by integrating
+ * its piecewise linear interpolant and normalizing to unit mass. Return the distribution at x or, if
+ * quantile=true, the quantile function at x, where x may be a list. All values are obtained from
+ * the same array, a quantile costs one binary search and the solution of a quadratic equation. */
+gen kde_cumulative(const vecteur &y,double a,double d,const gen &x,bool quantile,GIAC_CONTEXT) {
+    int bins=y.size();
+    assert(bins>1);
+    vector<double> f(bins),F(bins,0.0);
+    gen e;
+    for (int i=0;i<bins;++i) {
+        if ((e=_evalf(y[i],contextptr)).type!=_DOUBLE_)
+            return gensizeerr(contextptr);
+        f[i]=std::max(0.0,e.DOUBLE_val());
+        if (i>0)
+            F[i]=F[i-1]+d*(f[i-1]+f[i])/2;
+    }
+    double total=F.back();
+    if (total<=0)
+        return gensizeerr(contextptr);
+    for (int i=0;i<bins;++i) {
+        f[i]/=total;
+        F[i]/=total;
+    }
+    if (x.type==_IDNT) {
+        if (quantile) {
+            *logptr(contextptr) << "Error: probabilities are required" << endl;
+            return gensizeerr(contextptr);
+        }
+        vecteur res(bins);
+        for (int i=0;i<bins;++i) {
+            res[i]=F[i];
+        }
+        return res;
+    }
+    vecteur xv=x.type==_VECT?*x._VECTptr:vecteur(1,x),res;
+    res.reserve(xv.size());
+    for (const_iterateur it=xv.begin();it!=xv.end();++it) {
+        if ((e=_evalf(*it,contextptr)).type!=_DOUBLE_)
+            return gensizeerr(contextptr);
+        double t=e.DOUBLE_val(),s,k;
+        int i;
+        if (quantile) {
+            if (t<0 || t>1)
+                return gensizeerr(contextptr);
+            i=std::max(0,std::min(bins-2,int(std::upper_bound(F.begin(),F.end(),t)-F.begin())-1));
+            // solve F[i]+f[i]*s+k*s^2/2=t for s in [0,d]
+            double r=std::max(0.0,t-F[i]),disc;
+            k=(f[i+1]-f[i])/d;
+            disc=std::sqrt(std::max(0.0,f[i]*f[i]+2*k*r));
+            s=f[i]+disc>0?2*r/(f[i]+disc):0;
+            res.push_back(a+i*d+std::min(d,s));
+        } else if (t<=a)
+            res.push_back(0.0);
+        else if (t>=a+(bins-1)*d)
+            res.push_back(1.0);
+        else {
+            i=std::min(bins-2,int(std::floor((t-a)/d)));
+            s=t-a-i*d;
+            k=(f[i+1]-f[i])/d;
+            res.push_back(std::min(1.0,F[i]+f[i]*s+k*s*s/2));
+        }
+    }
+    return x.type==_VECT?gen(res):res.front();
+}
+
+/* compute the prominences of the local maxima of y in O(size(y)): the prominence of y[i] is its
+ * height above the higher of the two minima of y between i and the nearest higher value on each
+ * side (or the boundary) */
+void kde_prominences(const vector<double> &y,vector<double> &prom) {
+    int n=y.size();
+    vector<double> lmin(n),rmin(n);
+    vector<pair<int,double> > stack;
+    for (int dir=0;dir<2;++dir) {
+        vector<double> &mn=dir==0?lmin:rmin;
+        stack.clear();
+        for (int j=0;j<n;++j) {
+            int i=dir==0?j:n-1-j;
+            double m=y[i];
+            while (!stack.empty() && y[stack.back().first]<=y[i]) {
+                m=std::min(m,stack.back().second);
+                stack.pop_back();
+            }
+            stack.push_back(make_pair(i,m));
+            mn[i]=m;
+        }
+    }
+    prom.resize(n);
+    for (int i=0;i<n;++i) {
+        prom[i]=y[i]-std::max(lmin[i],rmin[i]);
+    }
+}
+
+/* find the local maxima and minima of the density y binned on the grid a+i*d, refine them by Newton
+ * steps on the exact Gaussian mixture restricted to the samples within 8*bw and return the matrices
+ * [maxima,minima] with rows [location,height,prominence] */
+gen kde_modes(const vector<double> &data,double bw,const vecteur &y,double a,double d,GIAC_CONTEXT) {
+    int bins=y.size(),n=data.size();
+    vector<double> f(bins),g(bins),pmax,pmin,sorted(data);
+    std::sort(sorted.begin(),sorted.end());
+    gen e;
+    double fmax=0;
+    for (int i=0;i<bins;++i) {
+        if ((e=_evalf(y[i],contextptr)).type!=_DOUBLE_)
+            return gensizeerr(contextptr);
+        g[i]=-(f[i]=e.DOUBLE_val());
+        fmax=std::max(fmax,f[i]);
+    }
+    kde_prominences(f,pmax);
+    kde_prominences(g,pmin);
+    double fac=1.0/(n*bw*std::sqrt(2.0*M_PI)),tol=1e-6*fmax,h2=bw*bw;
+    matrice maxima,minima;
+    for (int i=1;i+1<bins;++i) {
+        bool ismax=f[i-1]<f[i] && f[i]>=f[i+1],ismin=f[i-1]>f[i] && f[i]<=f[i+1];
+        if ((!ismax && !ismin) || (ismax?pmax[i]:pmin[i])<=tol) // ignore numerical noise
+            continue;
+        double x=a+i*d,x0=x,f0=0,f1,f2,t,k;
+        for (int iter=0;iter<=5;++iter) {
+            f0=f1=f2=0;
+            vector<double>::const_iterator it=std::lower_bound(sorted.begin(),sorted.end(),x-8*bw);
+            for (;it!=sorted.end() && *it<=x+8*bw;++it) {
+                t=(x-*it)/bw;
+                k=std::exp(-t*t/2);
+                f0+=k;
+                f1-=t*k/bw;
+                f2+=(t*t-1)*k/h2;
+            }
+            if (iter==5 || f2==0 || (ismax?f2>0:f2<0))
+                break;
+            t=std::max(x0-d,std::min(x0+d,x-f1/f2));
+            if (std::abs(t-x)<=1e-12*(1+std::abs(x))) {
+                x=t;
+                break;
+            }
+            x=t;
+        }
+        vecteur row=makevecteur(x,f0*fac,ismax?pmax[i]:pmin[i]);
+        if (ismax)
+            maxima.push_back(row);
+        else minima.push_back(row);
+    }
+    return makevecteur(maxima,minima);
+}
+
+#define KDE_SAMPLE_BLOCK 65536
+
+/* splitmix64 pseudo-random generator */
+unsigned long long splitmix64(unsigned long long &s) {
+    unsigned long long z=(s+=0x9E3779B97F4A7C15ULL);
+    z=(z^(z>>30))*0xBF58476D1CE4E5B9ULL;
+    z=(z^(z>>27))*0x94D049BB133111EBULL;
+    return z^(z>>31);
+}
+
+struct kde_sample_chunk {
+    const vector<double> *data;
+    double bw;
+    unsigned long long seed;
+    int m,start,end;
+    vecteur *out;
+};
+
+/* draw the samples in the blocks of the chunk, each block has its own random stream so that the
+ * result does not depend on the number of threads (storing a double in a gen allocates nothing,
+ * so the workers may fill disjoint parts of the output) */
+void *kde_sample_worker(void *arg) {
+    kde_sample_chunk *c=static_cast<kde_sample_chunk*>(arg);
+    const vector<double> &data=*c->data;
+    vecteur &out=*c->out;
+    int n=data.size();
+    const double r53=1.0/9007199254740992.0;
+    for (int blk=c->start;blk<c->end;++blk) {
+        unsigned long long s=c->seed^(0xD1B54A32D192ED03ULL*(unsigned long long)(blk+1));
+        int i0=blk*KDE_SAMPLE_BLOCK,i1=std::min(c->m,i0+KDE_SAMPLE_BLOCK);
+        for (int i=i0;i<i1;i+=2) { // Box-Muller transform gives two normal deviates
+            double r=c->bw*std::sqrt(-2*std::log(((splitmix64(s)>>11)+1)*r53)),t=2*M_PI*(splitmix64(s)>>11)*r53;
+            out[i]=gen(data[std::min(n-1,int((splitmix64(s)>>11)*r53*n))]+r*std::cos(t));
+            if (i+1<i1)
+                out[i+1]=gen(data[std::min(n-1,int((splitmix64(s)>>11)*r53*n))]+r*std::sin(t));
+        }
+    }
+    return NULL;
+}
+
+/* draw m samples from the kernel density estimate with Gaussian kernel and bandwidth bw, by adding
+ * Gaussian noise to randomly chosen data points, using at most nthreads threads */
+gen kde_sample(const vector<double> &data,double bw,int m,unsigned long long seed,int nthreads) {
+    opt_timer timer("kernel_density (sample)");
+    int nblocks=(m+KDE_SAMPLE_BLOCK-1)/KDE_SAMPLE_BLOCK;
+    nthreads=std::max(1,std::min(nthreads,nblocks));
+    vecteur res(m);
+    vector<kde_sample_chunk> chunks(nthreads);
+    for (int i=0;i<nthreads;++i) {
+        kde_sample_chunk &c=chunks[i];
+        c.data=&data;
+        c.bw=bw;
+        c.seed=seed;
+        c.m=m;
+        c.start=(i*nblocks)/nthreads;
+        c.end=((i+1)*nblocks)/nthreads;
+        c.out=&res;
+    }
+#ifdef HAVE_LIBPTHREAD
+    vector<pthread_t> threads(nthreads);
+    vector<bool> started(nthreads,false);
+    for (int i=1;i<nthreads;++i) {
+        started[i]=pthread_create(&threads[i],NULL,kde_sample_worker,&chunks[i])==0;
+    }
+    kde_sample_worker(&chunks[0]);
+    for (int i=1;i<nthreads;++i) {
+        if (started[i])
+            pthread_join(threads[i],NULL);
+        else kde_sample_worker(&chunks[i]);
+    }
+#else
+    for (int i=0;i<nthreads;++i) {
+        kde_sample_worker(&chunks[i]);
+    }
+#endif
+    return res;
+}
+
 bool parse_interval(const gen &feu,double &a,double &b,GIAC_CONTEXT) {
     vecteur &v=*feu._VECTptr;
     gen l=v.front(),r=v.back();
@@ -2680,13 +6809,16 @@ bool parse_interval(const gen &feu,double &a,double &b,GIAC_CONTEXT) {
     return true;
 }
 
-gen _kernel_density(const gen &g,GIAC_CONTEXT) {
-    if (g.type==_STRNG && g.subtype==-1) return g;
+/* parse the options in g and return the kernel density estimate for the data in g, or the kernel
+ * regression of yv on the data if yv is not NULL */
+gen kernel_smoother(const gen &g,const vector<double> *yv,GIAC_CONTEXT) {
     if (g.type!=_VECT)
         return gentypeerr(contextptr);
     gen x=identificateur("x");
     double a=0,b=0,bw=0,sd,d,sx=0,sxsq=0;
-    int bins=100,interp=1,method=_KDE_METHOD_LIST,bw_method=_KDE_BW_METHOD_DPI;
+    int bins=100,interp=1,method=_KDE_METHOD_LIST,bw_method=_KDE_BW_METHOD_DPI,smoothing=_KDE_SMOOTH_CONVOLUTION;
+    int nsamples=0,nthreads=1;
+    gen seed=undef;
     if (g.subtype==_SEQ__VECT) {
         // parse options
         for (const_iterateur it=g._VECTptr->begin()+1;it!=g._VECTptr->end();++it) {
@@ -2722,6 +6854,12 @@ gen _kernel_density(const gen &g,GIAC_CONTEXT) {
                         method=_KDE_METHOD_PIECEWISE;
                     else if (v==_MAPLE_LIST)
                         method=_KDE_METHOD_LIST;
+                    else if (is_option(v,"cdf",contextptr))
+                        method=_KDE_METHOD_CDF;
+                    else if (is_option(v,"quantile",contextptr))
+                        method=_KDE_METHOD_QUANTILE;
+                    else if (is_option(v,"modes",contextptr))
+                        method=_KDE_METHOD_MODES;
                     else return gensizeerr(contextptr);
                 } else if (opt==at_interp) {
                     if (!v.is_integer() || (interp=v.val)<1)
@@ -2730,6 +6868,22 @@ gen _kernel_density(const gen &g,GIAC_CONTEXT) {
                     if (!v.is_integer() || (interp=v.val)<1)
                         return gensizeerr(contextptr);
                     method=_KDE_METHOD_PIECEWISE;
+                } else if (is_option(opt,"smoothing",contextptr)) {
+                    if (is_option(v,"recursive",contextptr))
+                        smoothing=_KDE_SMOOTH_RECURSIVE;
+                    else if (v==at_convolution)
+                        smoothing=_KDE_SMOOTH_CONVOLUTION;
+                    else return gensizeerr(contextptr);
+                } else if (is_option(opt,"sample",contextptr)) {
+                    if (v.type!=_INT_ || (nsamples=v.val)<1)
+                        return gensizeerr(contextptr);
+                } else if (is_option(opt,"seed",contextptr)) {
+                    if (v.type!=_INT_)
+                        return gensizeerr(contextptr);
+                    seed=v;
+                } else if (is_option(opt,"threads",contextptr)) {
+                    if (v.type!=_INT_ || (nthreads=v.val)<1)
+                        return gensizeerr(contextptr);
                 } else if (opt.type==_IDNT) {
                     x=opt;
                     if (!v.is_symb_of_sommet(at_interval) || !parse_interval(v._SYMBptr->feuille,a,b,contextptr))
@@ -2747,7 +6901,12 @@ gen _kernel_density(const gen &g,GIAC_CONTEXT) {
             else return gensizeerr(contextptr);
         }
     }
-    if (x.type!=_IDNT && (_evalf(x,contextptr).type!=_DOUBLE_ || method==_KDE_METHOD_LIST))
+    if (yv!=NULL && (nsamples>0 || method==_KDE_METHOD_CDF || method==_KDE_METHOD_QUANTILE || method==_KDE_METHOD_MODES)) {
+        *logptr(contextptr) << "Error: this output is not available for kernel regression" << endl;
+        return gensizeerr(contextptr);
+    }
+    if (x.type!=_IDNT && method!=_KDE_METHOD_CDF && method!=_KDE_METHOD_QUANTILE &&
+            (_evalf(x,contextptr).type!=_DOUBLE_ || method==_KDE_METHOD_LIST || method==_KDE_METHOD_MODES))
         return gensizeerr(contextptr);
     vecteur &data=g.subtype==_SEQ__VECT?*g._VECTptr->front()._VECTptr:*g._VECTptr;
     int n=data.size();
@@ -2772,6 +6931,22 @@ gen _kernel_density(const gen &g,GIAC_CONTEXT) {
         a=_evalf(_min(data,contextptr),contextptr).DOUBLE_val()-3*bw;
         b=_evalf(_max(data,contextptr),contextptr).DOUBLE_val()+3*bw;
     }
+    if (nsamples>0) { // sample from the estimate, selecting the bandwidth as kernel_density does if needed
+        if (bw<=0) {
+            if (n<=1000)
+                bw=select_bandwidth_dpi(ddata,sd);
+            else {
+                if (bins<1 || b<=a)
+                    return gensizeerr(contextptr);
+                vecteur c,cy;
+                d=(b-a)/(bins-1);
+                kde_bin(ddata,NULL,bins,a,d,c,cy);
+                bw=select_bandwidth_dpi_bins(n,c,d,sd,contextptr);
+            }
+            *logptr(contextptr) << "selected bandwidth: " << bw << endl;
+        }
+        return kde_sample(ddata,bw,nsamples,is_undef(seed)?giac_rand(contextptr):seed.val,nthreads);
+    }
     if (method==_KDE_METHOD_EXACT)
         bins=0;
     else if (method==_KDE_METHOD_LIST) {
@@ -2781,8 +6956,28 @@ gen _kernel_density(const gen &g,GIAC_CONTEXT) {
     } else if (method==_KDE_METHOD_PIECEWISE) {
         if (bins<1 || interp<1)
             return gensizeerr(contextptr);
+    } else if (method==_KDE_METHOD_CDF || method==_KDE_METHOD_QUANTILE) {
+        if (bins<2)
+            return gensizeerr(contextptr);
+        gen dens=kernel_density(ddata,bw,sd,bins,a,b,0,identificateur(" x"),smoothing,NULL,contextptr);
+        if (dens.type!=_VECT)
+            return dens;
+        return kde_cumulative(*dens._VECTptr,a,(b-a)/(bins-1),x,method==_KDE_METHOD_QUANTILE,contextptr);
+    } else if (method==_KDE_METHOD_MODES) {
+        if (bins<3)
+            return gensizeerr(contextptr);
+        gen dens=kernel_density(ddata,bw,sd,bins,a,b,0,identificateur(" x"),smoothing,NULL,contextptr);
+        if (dens.type!=_VECT)
+            return dens;
+        return kde_modes(ddata,bw,*dens._VECTptr,a,(b-a)/(bins-1),contextptr);
     }
-    return kernel_density(ddata,bw,sd,bins,a,b,interp,x,contextptr);
+    return kernel_density(ddata,bw,sd,bins,a,b,interp,x,smoothing,yv,contextptr);
+}
+
+gen _kernel_density(const gen &g,GIAC_CONTEXT) {
+    if (g.type==_STRNG && g.subtype==-1) return g;
+    opt_timer timer("kernel_density");
+    return kernel_smoother(g,NULL,contextptr);
 }
 static const char _kernel_density_s []="kernel_density";
 static define_unary_function_eval (__kernel_density,&_kernel_density,_kernel_density_s);
@@ -2792,6 +6987,82 @@ static const char _kde_s []="kde";
 static define_unary_function_eval (__kde,&_kernel_density,_kde_s);
 define_unary_function_ptr5(at_kde,alias_at_kde,&__kde,0,true)
 
+/*
+ * 'kernel_regression' computes the Nadaraya-Watson estimate of the regression
+ * of y on x with Gaussian kernel, i.e. the kernel-weighted local average of
+ * the response. The estimate is obtained on the grid used by
+ * 'kernel_density' as the ratio of the smoothed sums of the responses and the
+ * smoothed counts of the binned data, in O(n+bins*log(bins)) time (or O(n+bins)
+ * with smoothing=recursive). The bandwidth is selected by the same methods as
+ * in 'kernel_density', applied to the explanatory data.
+ *
+ * Usage
+ * ^^^^^
+ *      kernel_regression(data_x,data_y,[opts])
+ * or   kernel_regression(points,[opts])
+ *
+ * Parameters
+ * ^^^^^^^^^^
+ *      - data_x    : list of values of the explanatory variable
+ *      - data_y    : list of responses of the same length as data_x
+ *      - points    : list of points [x,y]
+ *      - opts      : options of 'kernel_density' (bandwidth, bins, range,
+ *                    output=list|piecewise|exact, interp, spline, smoothing,
+ *                    eval and the variable)
+ *
+ * The return value is the list of estimates at the grid points by default,
+ * a piecewise interpolant or a ratio of exponential sums for output=exact.
+ * The estimate is undefined outside the range and where no data lie within
+ * a few bandwidths. The interpolant is constructed separately on each run of
+ * grid points where the estimate is defined, hence it is undefined only on
+ * the gaps between them.
+ *
+ * Examples
+ * ^^^^^^^^
+ * X:=randvector(1000,uniform,0,2*pi):;Y:=sin(X)+randvector(1000,normal,0,0.3):;
+ * kernel_regression(X,Y,bins=50)
+ * kernel_regression(X,Y,bandwidth=0.3,output=piecewise,x=0..2*pi)
+ * kernel_regression(X,Y,eval=1.5)
+ */
+gen _kernel_regression(const gen &g,GIAC_CONTEXT) {
+    if (g.type==_STRNG && g.subtype==-1) return g;
+    opt_timer timer("kernel_regression");
+    if (g.type!=_VECT || g._VECTptr->empty())
+        return gentypeerr(contextptr);
+    const vecteur &gv=*g._VECTptr;
+    vecteur X,Y,args;
+    const_iterateur opts;
+    if (g.subtype==_SEQ__VECT && gv.size()>=2 && gv[0].type==_VECT && gv[1].type==_VECT) {
+        X=*gv[0]._VECTptr;
+        Y=*gv[1]._VECTptr;
+        opts=gv.begin()+2;
+    } else {
+        const gen &pts=g.subtype==_SEQ__VECT?gv.front():g;
+        if (!ckmatrix(pts) || mcols(*pts._VECTptr)!=2)
+            return gentypeerr(contextptr);
+        for (const_iterateur it=pts._VECTptr->begin();it!=pts._VECTptr->end();++it) {
+            X.push_back(it->_VECTptr->front());
+            Y.push_back(it->_VECTptr->back());
+        }
+        opts=g.subtype==_SEQ__VECT?gv.begin()+1:gv.end();
+    }
+    if (X.size()!=Y.size())
+        return gensizeerr(contextptr);
+    vector<double> yv(Y.size());
+    gen e;
+    for (const_iterateur it=Y.begin();it!=Y.end();++it) {
+        if ((e=_evalf(*it,contextptr)).type!=_DOUBLE_)
+            return gensizeerr(contextptr);
+        yv[it-Y.begin()]=e.DOUBLE_val();
+    }
+    args.push_back(X);
+    args.insert(args.end(),opts,gv.end());
+    return kernel_smoother(gen(args,_SEQ__VECT),&yv,contextptr);
+}
+static const char _kernel_regression_s []="kernel_regression";
+static define_unary_function_eval (__kernel_regression,&_kernel_regression,_kernel_regression_s);
+define_unary_function_ptr5(at_kernel_regression,alias_at_kernel_regression,&__kernel_regression,0,true)
+
 #ifndef NO_NAMESPACE_GIAC
 }
 #endif // ndef NO_NAMESPACE_GIAC
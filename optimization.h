@@ -6,6 +6,9 @@
 #include "first.h"
 #include "gen.h"
 #include "unary.h"
+#include <list>
+#include <ctime>
+#include <chrono>
 
 #ifndef NO_NAMESPACE_GIAC
 namespace giac {
@@ -23,7 +26,15 @@ enum critical_point_classification {
 enum kernel_density_estimation_method {
     _KDE_METHOD_EXACT,
     _KDE_METHOD_PIECEWISE,
-    _KDE_METHOD_LIST
+    _KDE_METHOD_LIST,
+    _KDE_METHOD_CDF,
+    _KDE_METHOD_QUANTILE,
+    _KDE_METHOD_MODES
+};
+
+enum kernel_density_smoothing_method {
+    _KDE_SMOOTH_CONVOLUTION,
+    _KDE_SMOOTH_RECURSIVE
 };
 
 enum bandwidth_selection_method {
@@ -89,6 +100,54 @@ public:
     static int sum_ivector(const ivector &v,bool drop_last=false);
 };
 
+class opt_timer {
+    /* OPT_TIMER CLASS (OPTimization TIMER)
+     * The scoped timer for profiling the phases of the optimization commands: when profiling is
+     * enabled, it adds one call and the time elapsed during its lifetime to the counters of the given
+     * phase, otherwise it does nothing (the counters are shared by all threads) */
+    const char *phase;
+    bool active;
+    std::chrono::steady_clock::time_point start;
+public:
+    opt_timer(const char *ph);
+    ~opt_timer();
+    /* enable or disable profiling, enabling resets the counters */
+    static void enable(bool yes);
+    /* return true iff profiling is enabled */
+    static bool is_enabled();
+    /* return the table mapping the phase names to the lists [calls,nanoseconds] */
+    static gen table();
+};
+
+class opt_budget {
+    /* OPT_BUDGET CLASS (OPTimization BUDGET)
+     * The limits on the (wall clock) running time and on the number of candidate solutions for the optimization
+     * commands, set by the options timeout=t (in seconds) and maxcandidates=n and checked cooperatively
+     * at loop boundaries, so that the best partial result can be returned when a limit is reached */
+public:
+    enum status {
+        _OPT_BUDGET_OK, _OPT_BUDGET_TIMEOUT, _OPT_BUDGET_MAXCANDIDATES
+    };
+private:
+    double timeout; // the time limit in seconds (0 means no limit)
+    int maxcand; // the maximal number of candidates (0 means no limit)
+    int ncand; // the number of candidates found so far
+    std::chrono::steady_clock::time_point start;
+    int st;
+public:
+    opt_budget() : timeout(0),maxcand(0),ncand(0),start(std::chrono::steady_clock::now()),st(_OPT_BUDGET_OK) { }
+    /* parse the option timeout=t or maxcandidates=n, return false if opt is neither of them */
+    bool parse_option(const gen &opt,GIAC_CONTEXT);
+    /* return true iff a limit was reached */
+    bool exceeded();
+    /* count k new candidates and return true iff a limit was reached */
+    bool add_candidates(int k=1);
+    /* return the status */
+    int get_status() const { return st; }
+    /* return the name of the option whose limit was reached as an identifier, or undef */
+    gen flag() const;
+};
+
 class tprob {
     /* TPROB CLASS (Transportation PROBlem)
      * The class implementing the MODI method for balanced TP with degeneracy handling */
@@ -103,12 +162,232 @@ private:
     gen M; // symbol for marking forbidden routes in cost matrix
     void north_west_corner(matrice &feas);
     ipairs stepping_stone_path(ipairs &path_orig,const matrice &X);
-    void modi(const matrice &P_orig,matrice &X);
+    void modi(const matrice &P_orig,matrice &X,opt_budget *budget);
 public:
     /* construct the TP with supply s and demand d, m marks forbidden routes */
     tprob(const vecteur &s,const vecteur &d,const gen &m,GIAC_CONTEXT);
-    /* solve the transportation problem with the given cost matrix, output in sol */
-    void solve(const matrice &cost_matrix,matrice &sol);
+    /* solve the transportation problem with the given cost matrix, output in sol, if the budget
+     * is exceeded then the last feasible solution is returned */
+    void solve(const matrice &cost_matrix,matrice &sol,opt_budget *budget=NULL);
+};
+
+class cprog {
+    /* CPROG CLASS (Compiled PROGram)
+     * The class compiles a list of expressions in the given variables to a sequence of
+     * floating-point instructions in which common subexpressions are evaluated only once */
+public:
+    enum opcode {
+        _CP_CONST, _CP_VAR, _CP_ADD, _CP_MUL, _CP_NEG, _CP_INV, _CP_POWI, _CP_POW, _CP_SQRT,
+        _CP_EXP, _CP_LN, _CP_SIN, _CP_COS, _CP_TAN, _CP_ASIN, _CP_ACOS, _CP_ATAN,
+        _CP_SINH, _CP_COSH, _CP_TANH, _CP_ABS
+    };
+    struct instr {
+        int op; // opcode
+        int a,b; // indices of the operands
+        double c; // constant value or integer exponent
+    };
+private:
+    std::vector<instr> code;
+    std::vector<int> out; // indices of the instructions which compute the outputs
+    bool ok;
+    int compile(const gen &e,const vecteur &vars,std::map<const void*,int> &done,std::vector<int> &vi,GIAC_CONTEXT);
+    int push(int op,int a=-1,int b=-1,double c=0);
+public:
+    cprog() : ok(false) { }
+    /* compile the list of expressions exprs in variables vars */
+    cprog(const vecteur &exprs,const vecteur &vars,GIAC_CONTEXT);
+    /* return true iff all expressions were successfully compiled */
+    bool is_valid() const { return ok; }
+    /* return the number of outputs */
+    int size() const { return out.size(); }
+    /* evaluate the outputs at x and store them to res, work is used as a scratch buffer */
+    void eval(const double *x,double *res,std::vector<double> &work) const;
+};
+
+class sparse_ldlt {
+    /* SPARSE_LDLT CLASS
+     * The class implementing LDL' factorization of sparse symmetric matrices with a fixed nonzero
+     * pattern, using a minimum degree ordering and no pivoting (suitable for quasi-definite matrices) */
+    int n;
+    std::vector<int> colptr,rowind; // full nonzero pattern in compressed column format
+    std::vector<int> perm,pinv; // the fill-reducing ordering and its inverse
+    std::vector<int> parent,lcolptr; // elimination tree and column pointers of L
+    void min_degree(const std::vector<int> &stage);
+    void symbolic();
+public:
+    sparse_ldlt() : n(0) { }
+    /* construct the factorization for the sz x sz matrix with nonzeros at positions (i,j) in pattern,
+     * only one of (i,j) and (j,i) needs to be specified, diagonal entries are always included; the
+     * nodes i with stage[i]=0 are eliminated first and those with stage[i]=2 (e.g. having zero
+     * diagonal entries) are eliminated only after one of their neighbors */
+    sparse_ldlt(int sz,const std::vector<int> &stage,const std::vector<std::pair<int,int> > &pattern);
+    /* return the number of stored nonzeros */
+    int nnz() const { return rowind.size(); }
+    /* return the index of the entry (i,j) in the array of values, or -1 if (i,j) is not in the pattern */
+    int index(int i,int j) const;
+    /* factorize the matrix with the given values, return false if a zero pivot is encountered,
+     * otherwise store the number of negative pivots to neg */
+    bool factorize(const std::vector<double> &val,std::vector<double> &Lx,std::vector<int> &Li,std::vector<double> &D,int &neg) const;
+    /* solve the system using the factorization, the solution overwrites b */
+    void solve(const std::vector<double> &Lx,const std::vector<int> &Li,const std::vector<double> &D,std::vector<double> &b) const;
+};
+
+struct nlp_stats {
+    /* NLP_STATS STRUCT (NonLinear Programming STATiStics)
+     * The record of solver statistics which nlpsolve returns with the option stats=true */
+    std::string method; // the method used to solve the problem
+    std::string reason; // the termination reason
+    int iterations; // the number of iterations (-1 if not available)
+    int nfev,ngev,nhev; // the numbers of function, gradient and Hessian evaluations (-1 if not available)
+    std::vector<double> pinf,dinf; // the (scaled) constraint violation and dual infeasibility in each iteration
+    double phase1_time,phase2_time; // the wall time in seconds spent in finding a feasible point and in the optimization
+    nlp_stats() : iterations(-1),nfev(-1),ngev(-1),nhev(-1),phase1_time(0),phase2_time(0) {}
+};
+
+class nlprob {
+    /* NLPROB CLASS (NonLinear PROBlem)
+     * The class implementing a primal-dual interior point method for the problem
+     * min f(x) subject to c_i(x)=0 for i<meq and c_i(x)>=0 for meq<=i<m, where the
+     * functions and their first and second partial derivatives are compiled to cprog */
+public:
+    enum termination {
+        _IPM_CONVERGED, _IPM_ITERATION_LIMIT, _IPM_LINE_SEARCH_FAILED,
+        _IPM_SINGULAR_SYSTEM, _IPM_EVALUATION_ERROR
+    };
+private:
+    int n; // the number of variables
+    int m; // the number of constraints
+    int meq; // the number of equality constraints
+    int np; // the number of parameters
+    cprog fc; // computes f,c_1,c_2,..,c_m
+    cprog dfc; // computes the nonzero entries of grad(f) and the Jacobian of c
+    cprog d2fc; // computes the nonzero entries of the lower triangles of the Hessians of f,c_1,..,c_m
+    std::vector<int> jrow,jcol; // positions of the entries computed by dfc (row -1 is grad(f))
+    std::vector<int> hown,hpos; // owners (-1 is f) and positions in hrow,hcol of the entries computed by d2fc
+    std::vector<int> hrow,hcol; // nonzero pattern of the lower triangle of the Hessian of the Lagrangian
+    std::vector<std::vector<std::pair<int,int> > > hadj; // rows and entry indices of the nonzeros in each column of the Hessian
+    std::vector<std::vector<int> > hcolors; // column groups for computing the Hessian by finite differences
+    bool fdhess; // approximate the Hessian of the Lagrangian by finite differences of gradients
+    sparse_ldlt kkt; // the factorization of the augmented KKT matrix
+    std::vector<int> kdiag,kjac,khess; // indices of diagonal, Jacobian and Hessian entries in the KKT matrix
+    std::vector<double> lb,ub; // variable bounds (infinite if absent)
+    void color_hessian();
+    double bound_barrier(const double *x,const std::vector<bool> &hl,const std::vector<bool> &hu) const;
+    bool eval_fc(const double *x,double sf,const std::vector<double> &sc,std::vector<double> &res,std::vector<double> &work) const;
+    bool eval_jacobian(const double *x,double sf,const std::vector<double> &sc,std::vector<double> &g,std::vector<double> &J,std::vector<double> &work) const;
+    bool eval_lagrangian_gradient(const double *x,double sf,const std::vector<double> &sc,const std::vector<double> &lambda,
+                                  std::vector<double> &gl,std::vector<double> &work) const;
+    bool eval_hessian(const double *x,double sf,const std::vector<double> &sc,const std::vector<double> &lambda,
+                      std::vector<double> &W,std::vector<double> &work) const;
+public:
+    /* construct the problem with objective f, equality constraints eq=0 and inequality constraints ineq>=0,
+     * the expressions may depend on parameters params, whose values are passed to solve, the Hessian of the
+     * Lagrangian is approximated by finite differences if fd=true or if it is too large to be compiled */
+    nlprob(const gen &f,const vecteur &eq,const vecteur &ineq,const vecteur &vars,const vecteur &params,bool fd,GIAC_CONTEXT);
+    /* set the lower and upper bounds for the variables (-HUGE_VAL and HUGE_VAL mean no bound) */
+    void set_bounds(const std::vector<double> &lo,const std::vector<double> &hi);
+    /* return true iff the problem was successfully compiled */
+    bool is_valid() const { return fc.is_valid() && dfc.is_valid() && (fdhess || d2fc.is_valid()); }
+    /* return true iff the Hessian is approximated by finite differences */
+    bool is_fd_hessian() const { return fdhess; }
+    /* solve the problem starting from x, store the solution to x and the Lagrange multipliers to y
+     * (followed by the multipliers for the lower and upper bounds), if warm=true then y is used as the
+     * initial estimate of the multipliers, par are the parameter values, the statistics are stored to stats if given */
+    int solve(std::vector<double> &x,std::vector<double> &y,double tol,int maxiter,bool warm=false,const double *par=NULL,
+              nlp_stats *stats=NULL) const;
+    /* solve the problem for the values pv of a single parameter, starting each time from the previous solution,
+     * the values are split into nthreads contiguous chunks which are processed in parallel */
+    void sweep(const std::vector<double> &x0,const std::vector<double> &pv,double tol,int maxiter,int nthreads,
+               std::vector<std::vector<double> > &sol,std::vector<int> &status) const;
+    /* generate count start points by Latin hypercube sampling inside the bounds (unbounded variables are sampled
+     * around x0), store them to xs after x0 in the order of increasing violation and objective value, and store
+     * the widths of the sampling box to w */
+    void start_points(const std::vector<double> &x0,int count,std::vector<std::vector<double> > &xs,
+                      std::vector<double> &w,GIAC_CONTEXT) const;
+    /* run local solves from the start points xs in parallel using nthreads threads, skip the points which
+     * are closer than r to a solution found from a preceding start point (in the max-norm scaled by w) and
+     * store the distinct local solutions to sol, the result does not depend on nthreads */
+    void multistart(const std::vector<std::vector<double> > &xs,const std::vector<double> &w,double r,double tol,
+                    int maxiter,int nthreads,std::vector<std::vector<double> > &sol) const;
+    /* return the value of the objective at x for parameter values par */
+    double objective(const std::vector<double> &x,const double *par=NULL) const;
+    /* return the maximal violation of the constraints and bounds at x for parameter values par */
+    double violation(const std::vector<double> &x,const double *par=NULL) const;
+};
+
+class qprog {
+    /* QPROG CLASS (Quadratic PROGram)
+     * The class implementing numeric solvers for the problem min 1/2*x'*H*x+c'*x subject to
+     * A_E*x=b_E and A_I*x>=b_I, which is detected when the objective is at most quadratic and
+     * the constraints are linear; linear programs are solved by the simplex method and strictly
+     * convex quadratic programs by the dual active set method */
+public:
+    enum status {
+        _QP_OPTIMAL, _QP_INFEASIBLE, _QP_UNBOUNDED, _QP_NOT_CONVEX, _QP_ITERATION_LIMIT
+    };
+private:
+    int n; // the number of variables
+    int m; // the number of constraints
+    int meq; // the number of equality constraints
+    bool ok; // true iff the problem is linear or quadratic
+    bool linear; // true iff the objective is linear
+    std::vector<double> H,c; // the objective (H is stored by rows)
+    std::vector<double> A,b; // the constraints (A is stored by rows, equalities first)
+    std::vector<double> lb,ub; // variable bounds (infinite if absent)
+    double bound_value(int i) const;
+    int simplex(std::vector<double> &x,int maxiter,int &iter) const;
+    int dual_active_set(std::vector<double> &x,int maxiter,int &iter) const;
+public:
+    /* construct the problem with objective f, equality constraints eq=0 and inequality constraints ineq>=0 */
+    qprog(const gen &f,const vecteur &eq,const vecteur &ineq,const vecteur &vars,GIAC_CONTEXT);
+    /* set the lower and upper bounds for the variables (-HUGE_VAL and HUGE_VAL mean no bound) */
+    void set_bounds(const std::vector<double> &lo,const std::vector<double> &hi);
+    /* return true iff the objective is at most quadratic and the constraints are linear */
+    bool is_valid() const { return ok; }
+    /* return true iff the problem is a linear program */
+    bool is_linear() const { return linear; }
+    /* solve the problem, store the solution to x and return the status, the number of iterations is stored to iter */
+    int solve(std::vector<double> &x,int maxiter,int &iter) const;
+};
+
+class optcache {
+    /* OPTCACHE CLASS (OPTimization CACHE)
+     * The process-wide LRU cache of compiled problems, i.e. of the results of the expensive symbolic
+     * preprocessing (critical points found from the KKT conditions, classified critical points and
+     * compiled NLP problems) which depend only on the structure of the problem, so that repeated calls
+     * with the same model skip the differentiation, solving and compilation. The entries are keyed by
+     * the printed form of the problem together with the assumptions on its identifiers. */
+    struct entry {
+        gen value; // symbolic result
+        nlprob *prob; // compiled problem
+    };
+    typedef std::list<std::pair<std::string,entry> > entry_list;
+    entry_list entries; // the most recently used entry is at the front
+    std::map<std::string,entry_list::iterator> index;
+    int capacity; // the maximal number of entries
+    int hits,misses;
+    void insert(const std::string &key,const entry &e);
+    void shrink();
+    optcache() : capacity(64),hits(0),misses(0) { }
+public:
+    ~optcache();
+    /* return the unique instance of the cache */
+    static optcache &instance();
+    /* return the key for the problem of the given kind described by parts */
+    static std::string key(const char *kind,const vecteur &parts,GIAC_CONTEXT);
+    /* find the symbolic result for key and store it to value, return true on success */
+    bool find(const std::string &key,gen &value);
+    /* find the compiled problem for key and return its copy (owned by the caller) or NULL */
+    nlprob *find_problem(const std::string &key);
+    /* store the symbolic result value or a copy of the compiled problem prob with the given key */
+    void store(const std::string &key,const gen &value);
+    void store_problem(const std::string &key,const nlprob &prob);
+    /* set the maximal number of entries (0 disables caching) and remove the least recently used ones */
+    void set_capacity(int cap);
+    /* remove all entries and reset the counters */
+    void clear();
+    /* return the statistics (hits, misses, number of entries and capacity) as a table */
+    gen stats() const;
 };
 
 gen _implicitdiff(const gen &g,GIAC_CONTEXT);
@@ -119,8 +398,13 @@ gen _minimax(const gen &g,GIAC_CONTEXT);
 gen _tpsolve(const gen &g,GIAC_CONTEXT);
 gen _nlpsolve(const gen &g,GIAC_CONTEXT);
 gen _thiele(const gen &g,GIAC_CONTEXT);
+gen _aaa(const gen &g,GIAC_CONTEXT);
 gen _triginterp(const gen &g,GIAC_CONTEXT);
 gen _kernel_density(const gen &g,GIAC_CONTEXT);
+gen _kernel_regression(const gen &g,GIAC_CONTEXT);
+gen _optcache(const gen &g,GIAC_CONTEXT);
+gen _optprofile(const gen &g,GIAC_CONTEXT);
+gen _optbench(const gen &g,GIAC_CONTEXT);
 
 extern const unary_function_ptr * const at_implicitdiff;
 extern const unary_function_ptr * const at_minimize;
@@ -130,8 +414,13 @@ extern const unary_function_ptr * const at_minimax;
 extern const unary_function_ptr * const at_tpsolve;
 extern const unary_function_ptr * const at_nlpsolve;
 extern const unary_function_ptr * const at_thiele;
+extern const unary_function_ptr * const at_aaa;
 extern const unary_function_ptr * const at_triginterp;
 extern const unary_function_ptr * const at_kernel_density;
+extern const unary_function_ptr * const at_kernel_regression;
+extern const unary_function_ptr * const at_optcache;
+extern const unary_function_ptr * const at_optprofile;
+extern const unary_function_ptr * const at_optbench;
 
 #ifndef NO_NAMESPACE_GIAC
 } // namespace giac